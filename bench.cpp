@@ -0,0 +1,342 @@
+// Benchmarks of the detection kernels
+// build: g++ -std=c++17 -O2 -march=native -I. bench.cpp -o bench `pkg-config --cflags --libs opencv4` -pthread
+// usage: ./bench [filter] [--cpu N] [--repeats N] [--out bench_output.txt]
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <include_pkg/ColorLut.hpp>
+#include <include_pkg/MultiColorDetector.hpp>
+#include <include_pkg/Ortalama.hpp>
+#include <include_pkg/TiledDetector.hpp>
+#include <include_pkg/bench.hpp>
+#include <include_pkg/detect.hpp>
+#include <include_pkg/general.hpp>
+
+namespace {
+
+// the queue-based Ortalama that the ring buffer replaced, kept as the baseline
+template <class T>
+class QueueOrtalama {
+    std::queue<T> _list;
+    const size_t _N;
+    T _ort;
+
+public:
+    QueueOrtalama(size_t N)
+        : _N(N)
+        , _ort(0)
+    {
+    }
+    const T& ortalama = _ort;
+
+    void add(T x)
+    {
+        _ort = (_ort * _list.size() + x) / (_list.size() + 1);
+        _list.push(x);
+        if (_list.size() > _N) {
+            _ort = (_ort * _list.size() - _list.front()) / (_list.size() - 1);
+            _list.pop();
+        }
+    }
+};
+
+// the general::format that sized the text with a first snprintf and copied it from a heap
+// buffer, kept as the baseline
+template <typename... Args>
+std::string format_twice(const std::string& format, Args... args)
+{
+    int size_s = std::snprintf(nullptr, 0, format.c_str(), args...) + 1;
+    if (size_s <= 0) {
+        throw std::runtime_error("Error during formatting.");
+    }
+    auto size = static_cast<size_t>(size_s);
+    auto buf = std::make_unique<char[]>(size);
+    std::snprintf(buf.get(), size, format.c_str(), args...);
+    return std::string(buf.get(), buf.get() + size - 1);
+}
+
+void bench_frames(bench::Suite& suite)
+{
+    const std::tuple<cv::Scalar, int, int, int> params(cv::Scalar(40, 40, 220), 10, 80, 80);
+    const hsv::Bounds bounds = hsv::make_bounds(std::get<0>(params), std::get<1>(params),
+        std::get<2>(params), std::get<3>(params));
+    const ColorLut exact(bounds, ColorLut::Mode::Exact);
+    const ColorLut compact(bounds, ColorLut::Mode::Compact);
+    TiledColorDetector tiled;
+    const std::vector<std::tuple<cv::Scalar, int, int, int>> markers = { params,
+        { cv::Scalar(40, 220, 40), 10, 80, 80 }, { cv::Scalar(220, 40, 40), 10, 80, 80 },
+        { cv::Scalar(40, 220, 220), 10, 80, 80 } };
+    MultiColorDetector multi(markers, 3);
+
+    for (const auto& size : bench::sizes()) {
+        const cv::Mat img = bench::synthetic_frame(size.second);
+        cv::Mat mask;
+
+        suite.run("color_mask", size.first, [&] {
+            color_mask(img, mask, std::get<0>(params), std::get<1>(params),
+                std::get<2>(params), std::get<3>(params));
+            bench::do_not_optimize(mask.data);
+        });
+        suite.run("color_mask_lut_exact", size.first, [&] {
+            color_mask(img, mask, exact);
+            bench::do_not_optimize(mask.data);
+        });
+        suite.run("color_mask_lut_compact", size.first, [&] {
+            color_mask(img, mask, compact);
+            bench::do_not_optimize(mask.data);
+        });
+        suite.run("detect_color", size.first, [&] {
+            bench::do_not_optimize(detect_color(img, mask, params));
+        });
+        suite.run("detect_color_fit", size.first, [&] {
+            bench::do_not_optimize(detect_color_fit(img, mask, params));
+        });
+        suite.run("detect_color_tiled", size.first, [&] {
+            bench::do_not_optimize(tiled.detect_color(img, params));
+        });
+        // four marker colors: one detection per color against a single classifying pass
+        suite.run("detect_color_x4", size.first, [&] {
+            for (const auto& marker : markers) {
+                bench::do_not_optimize(detect_color(img, mask, marker));
+            }
+        });
+        suite.run("multi_color_detect_x4", size.first, [&] {
+            bench::do_not_optimize(multi.detect(img).size());
+        });
+    }
+}
+
+// one filled circle with a known sub-pixel center and radius on the noisy bench background
+cv::Mat circle_frame(cv::Size size, cv::Point2d center, double radius, uint64_t seed)
+{
+    cv::Mat img(size, CV_8UC3, cv::Scalar(90, 110, 100));
+    cv::circle(img, cv::Point(cvRound(center.x * 16), cvRound(center.y * 16)), cvRound(radius * 16),
+        cv::Scalar(40, 40, 220), cv::FILLED, cv::LINE_AA, 4);
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    for (int y = 0; y < img.rows; y++) {
+        uchar* p = img.ptr<uchar>(y);
+        for (int x = 0; x < img.cols * 3; x++) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            p[x] = cv::saturate_cast<uchar>(p[x] + static_cast<int>(state >> 59) - 16);
+        }
+    }
+    return img;
+}
+
+struct CircleAccuracy {
+    std::string name;
+    std::string input;
+    double center_mean = 0, center_max = 0;
+    double radius_mean = 0, radius_max = 0;
+    int misses = 0;
+};
+
+// the full resolution search against the pyramid levels: time on one frame, then localization
+// error over frames with known circles
+std::vector<CircleAccuracy> bench_circles(bench::Suite& suite)
+{
+    const int frames = 16;
+    const std::pair<const char*, int> detectors[] = { { "detect_circle", 0 },
+        { "detect_circle_pyramid_1", 1 }, { "detect_circle_pyramid_2", 2 } };
+    std::vector<CircleAccuracy> accuracy;
+    DetectorContext ctx;
+
+    for (const auto& size : bench::sizes()) {
+        const int side = std::min(size.second.width, size.second.height);
+        std::vector<cv::Mat> imgs;
+        std::vector<cv::Point3d> truth;
+        uint64_t state = 12345;
+        auto uniform = [&state](double lo, double hi) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            return lo + (hi - lo) * static_cast<double>(state >> 11) / static_cast<double>(uint64_t(1) << 53);
+        };
+        for (int i = 0; i < frames; i++) {
+            const double r = uniform(side / 12., side / 6.);
+            const cv::Point2d c(uniform(r + 8, size.second.width - r - 8),
+                uniform(r + 8, size.second.height - r - 8));
+            imgs.push_back(circle_frame(size.second, c, r, static_cast<uint64_t>(i) + 1));
+            truth.emplace_back(c.x, c.y, r);
+        }
+
+        for (const auto& d : detectors) {
+            const size_t before = suite.results().size();
+            suite.run(d.first, size.first, [&] {
+                bench::do_not_optimize(d.second == 0 ? ctx.detect_circle(imgs[0])
+                                                     : ctx.detect_circle_pyramid(imgs[0], d.second));
+            });
+            if (suite.results().size() == before) {
+                // filtered out
+                continue;
+            }
+            CircleAccuracy acc;
+            acc.name = d.first;
+            acc.input = size.first;
+            int found = 0;
+            for (int i = 0; i < frames; i++) {
+                const std::pair<cv::Point, int> res = d.second == 0
+                    ? ctx.detect_circle(imgs[i])
+                    : ctx.detect_circle_pyramid(imgs[i], d.second);
+                if (res.second == 0) {
+                    acc.misses++;
+                    continue;
+                }
+                const double dc = std::hypot(res.first.x - truth[i].x, res.first.y - truth[i].y);
+                const double dr = std::abs(res.second - truth[i].z);
+                acc.center_mean += dc;
+                acc.radius_mean += dr;
+                acc.center_max = std::max(acc.center_max, dc);
+                acc.radius_max = std::max(acc.radius_max, dr);
+                found++;
+            }
+            if (found > 0) {
+                acc.center_mean /= found;
+                acc.radius_mean /= found;
+            }
+            accuracy.push_back(acc);
+        }
+    }
+    return accuracy;
+}
+
+void print_circle_accuracy(const bench::Suite& suite, const std::vector<CircleAccuracy>& accuracy,
+    std::ostream& os = std::cout)
+{
+    if (accuracy.empty()) {
+        return;
+    }
+    const std::ios::fmtflags flags = os.flags();
+    os << "\n"
+       << std::left << std::setw(32) << "circle detector" << std::setw(8) << "input" << std::right
+       << std::setw(12) << "median us" << std::setw(14) << "center err" << std::setw(12) << "max"
+       << std::setw(14) << "radius err" << std::setw(12) << "max" << std::setw(8) << "misses"
+       << "\n";
+    os << std::fixed << std::setprecision(3);
+    for (const CircleAccuracy& a : accuracy) {
+        double median = 0;
+        for (const bench::Result& r : suite.results()) {
+            if (r.name == a.name && r.input == a.input) {
+                median = r.median;
+            }
+        }
+        os << std::left << std::setw(32) << a.name << std::setw(8) << a.input << std::right
+           << std::setw(12) << median / 1e3 << std::setw(14) << a.center_mean
+           << std::setw(12) << a.center_max << std::setw(14) << a.radius_mean
+           << std::setw(12) << a.radius_max << std::setw(8) << a.misses << "\n";
+    }
+    os.flags(flags);
+}
+
+void bench_smoothing(bench::Suite& suite)
+{
+    double x = 0;
+    QueueOrtalama<double> queue(16);
+    suite.run("ortalama_queue_add", "16", [&] {
+        queue.add(x += 0.5);
+        bench::do_not_optimize(queue.ortalama);
+    });
+    Ortalama<double> ring(16);
+    suite.run("ortalama_add", "16", [&] {
+        ring.add(x += 0.5);
+        bench::do_not_optimize(ring.ortalama);
+    });
+    Ortalama<double, 16> fixed;
+    suite.run("ortalama_fixed_add", "16", [&] {
+        fixed.add(x += 0.5);
+        bench::do_not_optimize(fixed.ortalama);
+    });
+    MultiOrtalama<double, 5> multi(16);
+    double sample[5] = { 0, 0, 0, 0, 0 };
+    suite.run("multi_ortalama_add", "5x16", [&] {
+        sample[0] = x += 0.5;
+        multi.add(sample);
+        bench::do_not_optimize(multi.mean());
+    });
+}
+
+void bench_format(bench::Suite& suite)
+{
+    int i = 0;
+    suite.run("format_snprintf_twice", "3 args", [&] {
+        bench::do_not_optimize(format_twice("frame %d: center (%d, %d)", i++, 320, 240));
+    });
+    suite.run("general_format", "3 args", [&] {
+        bench::do_not_optimize(GENERAL_FORMAT("frame %d: center (%d, %d)", i++, 320, 240));
+    });
+    char buf[64];
+    suite.run("general_format_to", "3 args", [&] {
+        bench::do_not_optimize(GENERAL_FORMAT_TO(buf, sizeof(buf), "frame %d: center (%d, %d)", i++, 320, 240));
+    });
+    suite.run("general_sformat", "3 args", [&] {
+        bench::do_not_optimize(GENERAL_SFORMAT("frame %d: center (%d, %d)", i++, 320, 240));
+    });
+}
+
+// the whole argument must be a number in the range of int, unlike std::atoi
+bool parse_int(const char* text, int& value)
+{
+    char* end = nullptr;
+    errno = 0;
+    const long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < INT_MIN || parsed > INT_MAX) {
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bench::Options opt;
+    std::string out = "bench_output.txt";
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--cpu" || arg == "--repeats" || arg == "--out") {
+            if (i + 1 >= argc) {
+                std::cerr << "bench: " << arg << " needs a value\n";
+                return EXIT_FAILURE;
+            }
+            const char* value = argv[++i];
+            if (arg == "--out") {
+                out = value;
+            } else if (!parse_int(value, arg == "--cpu" ? opt.cpu : opt.repeats)) {
+                std::cerr << "bench: " << arg << " expects an integer, got \"" << value << "\"\n";
+                return EXIT_FAILURE;
+            }
+        } else {
+            opt.filter = arg;
+        }
+    }
+    if (!opt.check() || opt.cpu < -1) {
+        std::cerr << "bench: --repeats must be at least 1 and --cpu at least -1\n";
+        return EXIT_FAILURE;
+    }
+
+    bench::Suite suite(opt);
+    bench_frames(suite);
+    const std::vector<CircleAccuracy> accuracy = bench_circles(suite);
+    bench_smoothing(suite);
+    bench_format(suite);
+
+    suite.print();
+    print_circle_accuracy(suite, accuracy);
+    suite.write(out);
+    std::cout << "results written to " << out << std::endl;
+}
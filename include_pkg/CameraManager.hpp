@@ -0,0 +1,656 @@
+#ifndef INCLUDE_PKG_CAMERAMANAGER_HPP
+#define INCLUDE_PKG_CAMERAMANAGER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif // __linux__
+
+#include <opencv2/videoio.hpp>
+
+#include <include_pkg/FrameSource.hpp>
+#include <include_pkg/Profiler.hpp>
+
+/**
+ * @brief A single capture device with its own capture thread and frame ring
+ *
+ * @details Frames are handed from the capture thread to the readers through a ring of
+ * preallocated cv::Mat slots without locks and without copying pixels. Cameras are normally
+ * created through CameraManager.
+ */
+class Camera {
+public:
+    /**
+     * @brief A captured image together with its capture metadata
+     */
+    struct Frame {
+        /**
+         * @brief Captured image, empty if no frame is available
+         */
+        cv::Mat img;
+
+        /**
+         * @brief Sequence number of the frame, starting from 1 and increased by one per capture
+         */
+        uint64_t seq = 0;
+
+        /**
+         * @brief The time the frame was read from the camera
+         */
+        std::chrono::steady_clock::time_point stamp;
+
+        /**
+         * @brief Pixel format of img as a FOURCC code, 0 for BGR; see FrameSource::fourcc
+         */
+        uint32_t fourcc = 0;
+    };
+
+    struct Options {
+        /**
+         * @brief Core the capture thread is pinned to (-1 to let the scheduler decide)
+         */
+        int cpu = -1;
+
+        /**
+         * @brief Number of preallocated frame slots (at least 3)
+         */
+        size_t slots = 3;
+
+        /**
+         * @brief Preferred OpenCV capture backend (e.g. cv::CAP_V4L2)
+         */
+        int api = cv::CAP_ANY;
+
+        /**
+         * @brief Allocator of the frame buffers (nullptr for OpenCV's default), e.g. a MatPool
+         * that outlives the camera
+         */
+        cv::MatAllocator* allocator = nullptr;
+
+        /**
+         * @brief Construct a new Options object
+         */
+        Options() { }
+
+        /**
+         * @brief Check whether the parameters in Options struct is valid
+         *
+         * @return true if all the parameters are valid
+         *         otherwise false
+         */
+        bool check() const;
+    };
+
+private:
+    /**
+     * @brief Where the frames come from (a physical camera, a file or a generator)
+     */
+    std::unique_ptr<FrameSource> _src;
+
+    /**
+     * @brief Pixel format of the frames of _src, fixed once it is open
+     */
+    uint32_t _fourcc;
+
+    /**
+     * @brief Preallocated frame buffers
+     *
+     * @details The capture thread writes into a slot that is neither the latest one nor pinned
+     * by a reader, then publishes it through _latest. Readers only ever copy the header of the
+     * latest slot, so no pixels are copied and no lock is taken on either side.
+     */
+    std::vector<cv::Mat> _slots;
+
+    /**
+     * @brief Sequence numbers of the frames in _slots
+     */
+    std::vector<uint64_t> _seqs;
+
+    /**
+     * @brief Capture timestamps of the frames in _slots
+     */
+    std::vector<std::chrono::steady_clock::time_point> _stamps;
+
+    /**
+     * @brief Number of readers currently copying the header of each slot
+     */
+    std::unique_ptr<std::atomic<int>[]> _pins;
+
+    /**
+     * @brief Whether the frame in each slot has been handed to a reader
+     */
+    std::unique_ptr<std::atomic<bool>[]> _taken;
+
+    /**
+     * @brief Index of the newest complete frame
+     */
+    std::atomic<int> _latest;
+
+    /**
+     * @brief Sequence number of the newest complete frame
+     */
+    std::atomic<uint64_t> _seq;
+
+    /**
+     * @brief Number of frames replaced before any reader took them
+     */
+    std::atomic<uint64_t> _dropped;
+
+    /**
+     * @brief Smoothed capture rate in frames per second
+     */
+    std::atomic<double> _fps;
+
+    /**
+     * @brief Number of consumers blocked in wait_next
+     *
+     * @details The capture thread only touches _wait_mutex when somebody is waiting.
+     */
+    mutable std::atomic<int> _waiters;
+
+    mutable std::mutex _wait_mutex;
+    mutable std::condition_variable _wait_cv;
+
+    /**
+     * @brief Keeps the capture thread alive while true
+     */
+    std::atomic<bool> _running;
+
+    std::thread _t;
+
+    /**
+     * @brief Allocate the slots, take the first image and start the capture thread
+     */
+    void _start(const Options& opt);
+
+    /**
+     * @brief Read images continously
+     *
+     * @details This function is used to read images from the camera by the capture thread.
+     * It backs off after consecutive failed reads and returns when the source is exhausted; the
+     * last frame then stays available.
+     */
+    void readImgForever();
+
+    /**
+     * @brief Pick the slot the next frame will be written into
+     *
+     * @details Slots whose pixels are still referenced by a snapshot are avoided when possible.
+     * If every candidate is shared, the pixels of the chosen slot are released so that the
+     * capture allocates a fresh buffer instead of overwriting a frame a reader still holds.
+     *
+     * @return size_t Index of a slot that no reader can access
+     */
+    size_t _acquire_slot();
+
+public:
+    /**
+     * @brief Open a camera by device index
+     *
+     * @param index Device index (e.g. 0 for /dev/video0)
+     * @param opt Capture options
+     */
+    Camera(int index, const Options& opt = Options());
+
+    /**
+     * @brief Open a camera by URL, stream or file name
+     *
+     * @param url Anything cv::VideoCapture accepts (e.g. rtsp://..., a GStreamer pipeline)
+     * @param opt Capture options
+     */
+    Camera(const std::string& url, const Options& opt = Options());
+
+    /**
+     * @brief Capture from any frame source (e.g. a file or a SyntheticSource for headless runs)
+     *
+     * @param src Frame source, owned by the camera
+     * @param opt Capture options (api is ignored)
+     */
+    Camera(std::unique_ptr<FrameSource> src, const Options& opt = Options());
+
+    /**
+     * @brief Destroy the Camera object
+     *
+     * @details This function releases the camera instance and stops the running image capture thread
+     */
+    ~Camera();
+
+    /**
+     * @brief Get the default camera (device 0 unless configured otherwise in CameraManager)
+     *
+     * @return std::shared_ptr<const Camera> The default camera
+     */
+    static std::shared_ptr<const Camera> getInstance();
+
+    /**
+     * @brief Get the latest image from the camera
+     *
+     * @details The returned matrix shares its pixels with the capture buffer (no copy) and is never
+     * written to again by the capture thread, so it can be held for as long as needed.
+     * This call never blocks the capture thread. It is in the format of the source, BGR unless
+     * the source says otherwise (see Frame::fourcc).
+     *
+     * @return cv::Mat Snapshot of the newest complete frame
+     */
+    cv::Mat img() const;
+
+    /**
+     * @brief Get the latest frame from the camera with its sequence number and timestamp
+     *
+     * @details Same as img() but also returns the capture metadata, so callers can skip a frame
+     * they have already processed.
+     *
+     * @return Frame Snapshot of the newest complete frame
+     */
+    Frame frame() const;
+
+    /**
+     * @brief Block until a frame newer than last_seq is captured
+     *
+     * @details Every call returns as soon as a frame with a greater sequence number exists, so a
+     * loop passing the sequence number of its previous result wakes exactly once per new frame.
+     * Frames captured while the caller was busy are skipped, not queued.
+     *
+     * @param last_seq Sequence number of the last frame the caller has processed (0 for none)
+     * @param timeout Maximum time to wait
+     * @return Frame The newest frame, or an empty frame (seq 0) on timeout
+     */
+    Frame wait_next(uint64_t last_seq,
+        std::chrono::milliseconds timeout = std::chrono::milliseconds(1000)) const;
+
+    /**
+     * @brief Get the capture rate, smoothed over the last few frames
+     *
+     * @return double Frames per second
+     */
+    double fps() const;
+
+    /**
+     * @brief Get the number of frames captured so far
+     *
+     * @return uint64_t Number of frames
+     */
+    uint64_t captured() const;
+
+    /**
+     * @brief Get the number of frames that were replaced by a newer one before any reader took them
+     *
+     * @return uint64_t Number of dropped frames
+     */
+    uint64_t dropped() const;
+
+    Camera(const Camera&) = delete;
+    Camera& operator=(const Camera&) = delete;
+    Camera(Camera&&) = delete;
+    Camera& operator=(Camera&&) = delete;
+};
+
+/**
+ * @brief Owns every open Camera of the process
+ *
+ * @details Cameras are registered once (usually at start-up) and looked up by id afterwards.
+ * The first camera added is the default one returned by Camera::getInstance(); if none is added,
+ * device 0 is opened on first use.
+ */
+class CameraManager {
+    std::vector<std::shared_ptr<const Camera>> _cameras;
+    mutable std::mutex _mutex;
+
+    CameraManager() = default;
+
+public:
+    /**
+     * @brief Get the process-wide manager
+     *
+     * @return CameraManager& The manager
+     */
+    static CameraManager& instance();
+
+    /**
+     * @brief Open a camera by device index
+     *
+     * @param index Device index
+     * @param opt Capture options
+     * @return size_t Id of the camera
+     */
+    size_t open(int index, const Camera::Options& opt = Camera::Options());
+
+    /**
+     * @brief Open a camera by URL, stream or file name
+     *
+     * @param url Anything cv::VideoCapture accepts
+     * @param opt Capture options
+     * @return size_t Id of the camera
+     */
+    size_t open(const std::string& url, const Camera::Options& opt = Camera::Options());
+
+    /**
+     * @brief Open a camera on any frame source
+     *
+     * @param src Frame source, owned by the camera
+     * @param opt Capture options
+     * @return size_t Id of the camera
+     */
+    size_t open(std::unique_ptr<FrameSource> src, const Camera::Options& opt = Camera::Options());
+
+    /**
+     * @brief Get a camera by id
+     *
+     * @param id Id returned by open()
+     * @return std::shared_ptr<const Camera> The camera
+     */
+    std::shared_ptr<const Camera> get(size_t id) const;
+
+    /**
+     * @brief Get the default camera, opening device 0 if no camera is open yet
+     *
+     * @return std::shared_ptr<const Camera> The default camera
+     */
+    std::shared_ptr<const Camera> get_default();
+
+    /**
+     * @brief Get the number of open cameras
+     *
+     * @return size_t Number of cameras
+     */
+    size_t size() const;
+
+    /**
+     * @brief Print id, fps and dropped-frame count of every camera
+     *
+     * @param os Output stream
+     */
+    void print_stats(std::ostream& os = std::cout) const;
+
+    CameraManager(const CameraManager&) = delete;
+    CameraManager& operator=(const CameraManager&) = delete;
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline bool Camera::Options::check() const
+{
+    return slots >= 3 && cpu >= -1;
+}
+
+inline Camera::Camera(int index, const Options& opt)
+    : _src(new VideoCaptureSource(index, opt.api))
+{
+    _start(opt);
+}
+
+inline Camera::Camera(const std::string& url, const Options& opt)
+    : _src(new VideoCaptureSource(url, opt.api))
+{
+    _start(opt);
+}
+
+inline Camera::Camera(std::unique_ptr<FrameSource> src, const Options& opt)
+    : _src(std::move(src))
+{
+    _start(opt);
+}
+
+inline void Camera::_start(const Options& opt)
+{
+    if (!opt.check()) {
+        throw std::invalid_argument("Invalid camera options.");
+    }
+    _slots.resize(opt.slots);
+    for (cv::Mat& slot : _slots) {
+        // kept across release(), so frames reallocated later come from the same allocator
+        slot.allocator = opt.allocator;
+    }
+    _seqs.assign(opt.slots, 0);
+    _stamps.resize(opt.slots);
+    _pins.reset(new std::atomic<int>[opt.slots]());
+    _taken.reset(new std::atomic<bool>[opt.slots]());
+    _latest = 0;
+    _seq = 1;
+    _dropped = 0;
+    _fps = 0;
+    _waiters = 0;
+    _running = true;
+
+    if (!_src || !_src->isOpened() || !_src->read(_slots[0]) || _slots[0].empty()) {
+        throw std::runtime_error("Camera could not be opened.");
+    }
+    _fourcc = _src->fourcc();
+    _seqs[0] = 1;
+    _stamps[0] = std::chrono::steady_clock::now();
+    _t = std::thread(&Camera::readImgForever, this);
+
+#ifdef __linux__
+    if (opt.cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(opt.cpu, &set);
+        if (pthread_setaffinity_np(_t.native_handle(), sizeof(set), &set) != 0) {
+            std::cerr << "Camera: could not pin capture thread to core " << opt.cpu << std::endl;
+        }
+    }
+#endif // __linux__
+}
+
+inline Camera::~Camera()
+{
+    _running = false;
+    if (_t.joinable()) {
+        _t.join();
+    }
+    _src->release();
+}
+
+inline std::shared_ptr<const Camera> Camera::getInstance()
+{
+    return CameraManager::instance().get_default();
+}
+
+inline size_t Camera::_acquire_slot()
+{
+    while (true) {
+        const int latest = _latest.load();
+        int shared = -1;
+        for (size_t i = 0; i < _slots.size(); i++) {
+            if (static_cast<int>(i) == latest || _pins[i].load() != 0) {
+                continue;
+            }
+            // only this thread can add references to an unpinned, unpublished slot
+            cv::UMatData* u = _slots[i].u;
+            if (!u || CV_XADD(&u->refcount, 0) <= 1) {
+                return i;
+            }
+            shared = static_cast<int>(i);
+        }
+        if (shared >= 0) {
+            _slots[shared].release();
+            return static_cast<size_t>(shared);
+        }
+        std::this_thread::yield();
+    }
+}
+
+inline void Camera::readImgForever()
+{
+    int failures = 0;
+    while (_running.load(std::memory_order_relaxed)) {
+        const size_t slot = _acquire_slot();
+        bool ok;
+        {
+            PROFILE_SCOPE("camera_read");
+            ok = _src->read(_slots[slot]) && !_slots[slot].empty();
+        }
+        if (!ok) {
+            if (_src->exhausted()) {
+                break;
+            }
+            // an unplugged device fails at once; retry a few times, then back off up to 100 ms
+            if (++failures > 3) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(
+                    std::min(100, 1 << std::min(failures - 4, 7))));
+            }
+            continue;
+        }
+        failures = 0;
+        const uint64_t seq = _seq.load(std::memory_order_relaxed) + 1;
+        const auto now = std::chrono::steady_clock::now();
+        const int prev = _latest.load(std::memory_order_relaxed);
+        const double dt = std::chrono::duration<double>(now - _stamps[prev]).count();
+        if (dt > 0) {
+            const double fps = _fps.load(std::memory_order_relaxed);
+            _fps.store(fps == 0 ? 1 / dt : 0.9 * fps + 0.1 / dt, std::memory_order_relaxed);
+        }
+
+        _stamps[slot] = now;
+        _seqs[slot] = seq;
+        _taken[slot].store(false, std::memory_order_relaxed);
+        _latest.store(static_cast<int>(slot));
+        _seq.store(seq);
+        if (!_taken[prev].load(std::memory_order_relaxed)) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (_waiters.load() > 0) {
+            // the lock orders the store against a waiter that is about to sleep
+            { std::lock_guard<std::mutex> lock(_wait_mutex); }
+            _wait_cv.notify_all();
+        }
+    }
+}
+
+inline cv::Mat Camera::img() const
+{
+    return frame().img;
+}
+
+inline Camera::Frame Camera::frame() const
+{
+    while (true) {
+        const int idx = _latest.load();
+        _pins[idx].fetch_add(1);
+        // the slot may have been recycled between the load and the pin
+        if (_latest.load() == idx) {
+            Frame snapshot { _slots[idx], _seqs[idx], _stamps[idx], _fourcc };
+            _taken[idx].store(true, std::memory_order_relaxed);
+            _pins[idx].fetch_sub(1);
+            return snapshot;
+        }
+        _pins[idx].fetch_sub(1);
+    }
+}
+
+inline Camera::Frame Camera::wait_next(uint64_t last_seq,
+    std::chrono::milliseconds timeout) const
+{
+    if (_seq.load() <= last_seq) {
+        _waiters.fetch_add(1);
+        bool ready;
+        {
+            std::unique_lock<std::mutex> lock(_wait_mutex);
+            ready = _wait_cv.wait_for(lock, timeout,
+                [&] { return _seq.load() > last_seq; });
+        }
+        _waiters.fetch_sub(1);
+        if (!ready) {
+            return Frame();
+        }
+    }
+    return frame();
+}
+
+inline double Camera::fps() const
+{
+    return _fps.load(std::memory_order_relaxed);
+}
+
+inline uint64_t Camera::captured() const
+{
+    return _seq.load(std::memory_order_relaxed);
+}
+
+inline uint64_t Camera::dropped() const
+{
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+inline CameraManager& CameraManager::instance()
+{
+    static CameraManager manager;
+    return manager;
+}
+
+inline size_t CameraManager::open(int index, const Camera::Options& opt)
+{
+    auto cam = std::make_shared<const Camera>(index, opt);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _cameras.push_back(std::move(cam));
+    return _cameras.size() - 1;
+}
+
+inline size_t CameraManager::open(const std::string& url, const Camera::Options& opt)
+{
+    auto cam = std::make_shared<const Camera>(url, opt);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _cameras.push_back(std::move(cam));
+    return _cameras.size() - 1;
+}
+
+inline size_t CameraManager::open(std::unique_ptr<FrameSource> src, const Camera::Options& opt)
+{
+    auto cam = std::make_shared<const Camera>(std::move(src), opt);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _cameras.push_back(std::move(cam));
+    return _cameras.size() - 1;
+}
+
+inline std::shared_ptr<const Camera> CameraManager::get(size_t id) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (id >= _cameras.size()) {
+        throw std::out_of_range("No camera with the given id.");
+    }
+    return _cameras[id];
+}
+
+inline std::shared_ptr<const Camera> CameraManager::get_default()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_cameras.empty()) {
+        _cameras.push_back(std::make_shared<const Camera>(0));
+    }
+    return _cameras.front();
+}
+
+inline size_t CameraManager::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _cameras.size();
+}
+
+inline void CameraManager::print_stats(std::ostream& os) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < _cameras.size(); i++) {
+        os << "camera " << i << ": " << _cameras[i]->fps() << " fps, "
+           << _cameras[i]->captured() << " captured, "
+           << _cameras[i]->dropped() << " dropped\n";
+    }
+}
+
+#endif // INCLUDE_PKG_CAMERAMANAGER_HPP
@@ -0,0 +1,223 @@
+#ifndef INCLUDE_PKG_COLORLUT_HPP
+#define INCLUDE_PKG_COLORLUT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <include_pkg/hsv.hpp>
+
+/**
+ * @brief Precomputed BGR -> accepted lookup table for a fixed HSV box
+ *
+ * @details The table is built once per parameter set; thresholding a pixel is then a single bit
+ * lookup instead of an HSV conversion. Two layouts are available:
+ * - Exact: one bit for every 24-bit color (2 MiB), same result as hsv::threshold
+ * - Compact: one byte for every 32x32x32 cell (32 KiB), fits in L1 and needs no bit
+ *   extraction, but a cell is accepted or rejected as a whole depending on its center color,
+ *   so pixels near the box edges may differ
+ */
+class ColorLut {
+public:
+    enum class Mode {
+        Exact,
+        Compact
+    };
+
+private:
+    Mode _mode;
+    hsv::Bounds _bounds;
+    bool _built;
+
+    /**
+     * @brief Exact mode: one bit per 24-bit color, indexed by (r << 16) | (g << 8) | b
+     */
+    std::vector<uint64_t> _bits;
+
+    /**
+     * @brief Compact mode: the mask value of each cell, indexed by (r >> 3 << 10) | (g >> 3 << 5) | b >> 3
+     */
+    std::vector<uchar> _cells;
+
+    void _build();
+
+public:
+    /**
+     * @brief Construct an empty table, built on the first call to set
+     *
+     * @param mode Table layout
+     */
+    ColorLut(Mode mode = Mode::Exact);
+
+    /**
+     * @brief Construct and build a table for the given box
+     *
+     * @param bounds Accepted HSV box
+     * @param mode Table layout
+     */
+    ColorLut(const hsv::Bounds& bounds, Mode mode = Mode::Exact);
+
+    /**
+     * @brief Set the accepted HSV box, rebuilding the table only if it changed
+     *
+     * @param bounds Accepted HSV box
+     * @return true if the table was rebuilt
+     *         otherwise false
+     */
+    bool set(const hsv::Bounds& bounds);
+
+    /**
+     * @brief Set the accepted color the same way as color_mask, rebuilding only if it changed
+     *
+     * @param color Desired color in (B, G, R) order, as returned by read_params
+     * @param hue_range Hue range
+     * @param saturation_range Saturation range
+     * @param value_range Value range
+     * @return true if the table was rebuilt
+     *         otherwise false
+     */
+    bool set(cv::Scalar color, int hue_range, int saturation_range, int value_range);
+
+    /**
+     * @brief Get the box the table was built for
+     */
+    const hsv::Bounds& bounds() const;
+
+    /**
+     * @brief Get the table layout
+     */
+    Mode mode() const;
+
+    /**
+     * @brief Check whether a BGR color is accepted
+     */
+    bool accept(uchar b, uchar g, uchar r) const;
+
+    /**
+     * @brief Threshold a BGR image with one lookup per pixel
+     *
+     * @param bgr 8-bit 3-channel BGR image
+     * @param mask The output mask (CV_8UC1, 255 for accepted pixels), reallocated only if its size changes
+     */
+    void apply(const cv::Mat& bgr, cv::Mat& mask) const;
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline ColorLut::ColorLut(Mode mode)
+    : _mode(mode)
+    , _bounds()
+    , _built(false)
+{
+}
+
+inline ColorLut::ColorLut(const hsv::Bounds& bounds, Mode mode)
+    : ColorLut(mode)
+{
+    set(bounds);
+}
+
+inline bool ColorLut::set(const hsv::Bounds& bounds)
+{
+    if (_built && bounds == _bounds) {
+        return false;
+    }
+    _bounds = bounds;
+    _build();
+    _built = true;
+    return true;
+}
+
+inline bool ColorLut::set(cv::Scalar color, int hue_range, int saturation_range, int value_range)
+{
+    return set(hsv::make_bounds(color, hue_range, saturation_range, value_range));
+}
+
+inline const hsv::Bounds& ColorLut::bounds() const
+{
+    return _bounds;
+}
+
+inline ColorLut::Mode ColorLut::mode() const
+{
+    return _mode;
+}
+
+inline void ColorLut::_build()
+{
+    const int levels = _mode == Mode::Exact ? 256 : 32;
+    const int step = 256 / levels;
+    if (_mode == Mode::Exact) {
+        _bits.assign(static_cast<size_t>(levels) * levels * levels / 64, 0);
+    } else {
+        _cells.assign(static_cast<size_t>(levels) * levels * levels, 0);
+    }
+
+    // classify one row of blue values at a time with the HSV kernel
+    std::vector<uchar> row(3 * levels), accepted(levels);
+    for (int r = 0; r < levels; r++) {
+        for (int g = 0; g < levels; g++) {
+            for (int b = 0; b < levels; b++) {
+                row[3 * b] = static_cast<uchar>(b * step + step / 2);
+                row[3 * b + 1] = static_cast<uchar>(g * step + step / 2);
+                row[3 * b + 2] = static_cast<uchar>(r * step + step / 2);
+            }
+            hsv::threshold_row(row.data(), accepted.data(), levels, _bounds);
+            const size_t base = (static_cast<size_t>(r) * levels + g) * levels;
+            if (_mode == Mode::Compact) {
+                std::copy(accepted.begin(), accepted.end(), _cells.begin() + base);
+                continue;
+            }
+            for (int b = 0; b < levels; b++) {
+                if (accepted[b]) {
+                    _bits[(base + b) >> 6] |= uint64_t(1) << ((base + b) & 63);
+                }
+            }
+        }
+    }
+}
+
+inline bool ColorLut::accept(uchar b, uchar g, uchar r) const
+{
+    if (_mode == Mode::Compact) {
+        return _cells[(size_t(r >> 3) << 10) | (size_t(g >> 3) << 5) | (b >> 3)] != 0;
+    }
+    const size_t i = (size_t(r) << 16) | (size_t(g) << 8) | b;
+    return (_bits[i >> 6] >> (i & 63)) & 1;
+}
+
+inline void ColorLut::apply(const cv::Mat& bgr, cv::Mat& mask) const
+{
+    if (!_built) {
+        throw std::logic_error("ColorLut::apply called before set.");
+    }
+    if (bgr.type() != CV_8UC3) {
+        throw std::invalid_argument("ColorLut::apply expects an 8-bit BGR image.");
+    }
+    mask.create(bgr.rows, bgr.cols, CV_8UC1);
+    const uint64_t* bits = _bits.data();
+    const uchar* cells = _cells.data();
+    for (int y = 0; y < bgr.rows; y++) {
+        const uchar* src = bgr.ptr<uchar>(y);
+        uchar* dst = mask.ptr<uchar>(y);
+        if (_mode == Mode::Exact) {
+            for (int x = 0; x < bgr.cols; x++, src += 3) {
+                const uint32_t i = (uint32_t(src[2]) << 16) | (uint32_t(src[1]) << 8) | src[0];
+                dst[x] = static_cast<uchar>(-static_cast<int>((bits[i >> 6] >> (i & 63)) & 1));
+            }
+        } else {
+            for (int x = 0; x < bgr.cols; x++, src += 3) {
+                const uint32_t i = (uint32_t(src[2] >> 3) << 10) | (uint32_t(src[1] >> 3) << 5) | (src[0] >> 3);
+                dst[x] = cells[i];
+            }
+        }
+    }
+}
+
+#endif // INCLUDE_PKG_COLORLUT_HPP
@@ -0,0 +1,233 @@
+#ifndef INCLUDE_PKG_COLORTRACKER_HPP
+#define INCLUDE_PKG_COLORTRACKER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#include <opencv2/core.hpp>
+
+#include <include_pkg/blob.hpp>
+#include <include_pkg/hsv.hpp>
+
+/**
+ * @brief Tracks the biggest group of a color by searching only around its predicted position
+ *
+ * @details Once the target is found, the next search window is centered on the position predicted
+ * by a constant-velocity model and sized from the last radius and speed. Only when the target has
+ * been missing for Options::lost_frames consecutive frames does the tracker go back to scanning
+ * the whole frame.
+ */
+class ColorTracker {
+public:
+    struct Options {
+        /**
+         * @brief Number of consecutive misses after which the whole frame is searched again
+         */
+        int lost_frames = 5;
+
+        /**
+         * @brief Half size of the search window as a multiple of the last radius
+         */
+        double margin = 2.0;
+
+        /**
+         * @brief Extra pixels added to each side of the search window
+         */
+        int padding = 16;
+
+        /**
+         * @brief Groups smaller than this many pixels are ignored
+         */
+        int min_area = 1;
+
+        /**
+         * @brief Weight of the newest velocity measurement (1 to use only the last displacement)
+         */
+        double velocity_gain = 0.5;
+
+        /**
+         * @brief Construct a new Options object
+         */
+        Options() { }
+
+        /**
+         * @brief Check whether the parameters in Options struct is valid
+         *
+         * @return true if all the parameters are valid
+         *         otherwise false
+         */
+        bool check() const;
+    };
+
+private:
+    hsv::Bounds _bounds;
+    Options _opt;
+    BlobLabeler _labeler;
+
+    /**
+     * @brief Frame sized mask buffer; the window of each search is thresholded into its top left
+     * corner, so it is only reallocated when the frame size changes
+     */
+    cv::Mat _mask;
+
+    cv::Point2d _pos;
+    cv::Point2d _vel;
+    double _radius;
+    int _missed;
+    bool _tracking;
+    cv::Rect _roi;
+
+    /**
+     * @brief Find the biggest group inside a window of the image
+     *
+     * @return Blob The group in full-image coordinates (cnt is 0 if none)
+     */
+    Blob _search(const cv::Mat& image, const cv::Rect& roi);
+
+public:
+    /**
+     * @brief Construct a new ColorTracker object
+     *
+     * @param params Color detection parameters as returned by read_params
+     * @param opt Tracker options
+     */
+    ColorTracker(const std::tuple<cv::Scalar, int, int, int>& params,
+        const Options& opt = Options());
+
+    /**
+     * @brief Find the target in the next frame
+     *
+     * @param image The input BGR image
+     * @return A pair containing the center and radius of the detected group (radius 0 if none)
+     */
+    std::pair<cv::Point, int> update(const cv::Mat& image);
+
+    /**
+     * @brief Check whether the tracker is searching a window instead of the whole frame
+     */
+    bool tracking() const;
+
+    /**
+     * @brief Get the window searched in the last update
+     */
+    cv::Rect roi() const;
+
+    /**
+     * @brief Forget the target and search the whole frame on the next update
+     */
+    void reset();
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline bool ColorTracker::Options::check() const
+{
+    return lost_frames > 0 && margin > 0 && padding >= 0 && min_area > 0
+        && velocity_gain > 0 && velocity_gain <= 1;
+}
+
+inline ColorTracker::ColorTracker(const std::tuple<cv::Scalar, int, int, int>& params,
+    const Options& opt)
+    : _bounds(hsv::make_bounds(std::get<0>(params), std::get<1>(params),
+        std::get<2>(params), std::get<3>(params)))
+    , _opt(opt)
+{
+    if (!_opt.check()) {
+        throw std::invalid_argument("Invalid tracker options.");
+    }
+    reset();
+}
+
+inline void ColorTracker::reset()
+{
+    _pos = _vel = cv::Point2d();
+    _radius = 0;
+    _missed = 0;
+    _tracking = false;
+    _roi = cv::Rect();
+}
+
+inline bool ColorTracker::tracking() const
+{
+    return _tracking;
+}
+
+inline cv::Rect ColorTracker::roi() const
+{
+    return _roi;
+}
+
+inline Blob ColorTracker::_search(const cv::Mat& image, const cv::Rect& roi)
+{
+    _mask.create(image.rows, image.cols, CV_8UC1);
+    cv::Mat mask = _mask(cv::Rect(0, 0, roi.width, roi.height));
+    hsv::threshold(image(roi), mask, _bounds);
+    Blob blob = _labeler.largest(mask);
+    if (blob.cnt < _opt.min_area) {
+        return Blob();
+    }
+    blob.totX += blob.cnt * roi.x;
+    blob.totY += blob.cnt * roi.y;
+    blob.x0 += roi.x;
+    blob.x1 += roi.x;
+    blob.y0 += roi.y;
+    blob.y1 += roi.y;
+    return blob;
+}
+
+inline std::pair<cv::Point, int> ColorTracker::update(const cv::Mat& image)
+{
+    const cv::Rect frame(0, 0, image.cols, image.rows);
+    const cv::Point2d last = _pos;
+    const cv::Point2d predicted = _pos + _vel;
+
+    if (_tracking) {
+        const double speed = std::hypot(_vel.x, _vel.y);
+        const int half = static_cast<int>(_radius * _opt.margin + speed) + _opt.padding;
+        _roi = cv::Rect(static_cast<int>(predicted.x) - half, static_cast<int>(predicted.y) - half,
+                   2 * half + 1, 2 * half + 1)
+            & frame;
+    } else {
+        _roi = frame;
+    }
+
+    Blob blob = _roi.empty() ? Blob() : _search(image, _roi);
+
+    // a group cut by the window border may extend further; search once more around all of it
+    const cv::Rect r = blob.rect();
+    if (blob.cnt > 0 && _roi != frame
+        && ((r.x == _roi.x && r.x > 0) || (r.y == _roi.y && r.y > 0)
+            || (r.br().x == _roi.br().x && r.br().x < frame.width)
+            || (r.br().y == _roi.br().y && r.br().y < frame.height))) {
+        const int grow = std::max(r.width, r.height) + _opt.padding;
+        _roi = cv::Rect(r.x - grow, r.y - grow, r.width + 2 * grow, r.height + 2 * grow) & frame;
+        blob = _search(image, _roi);
+    }
+
+    if (blob.cnt == 0) {
+        // coast on the prediction until the target is declared lost
+        _pos = predicted;
+        if (++_missed >= _opt.lost_frames) {
+            reset();
+        }
+        return { cv::Point(), 0 };
+    }
+
+    const cv::Point2d measured(static_cast<double>(blob.totX) / blob.cnt,
+        static_cast<double>(blob.totY) / blob.cnt);
+    if (_tracking) {
+        _vel = _vel * (1 - _opt.velocity_gain) + (measured - last) * _opt.velocity_gain;
+    }
+    _pos = measured;
+    _radius = blob.radius();
+    _missed = 0;
+    _tracking = true;
+    return { blob.center(), blob.radius() };
+}
+
+#endif // INCLUDE_PKG_COLORTRACKER_HPP
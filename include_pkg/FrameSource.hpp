@@ -0,0 +1,524 @@
+#ifndef INCLUDE_PKG_FRAMESOURCE_HPP
+#define INCLUDE_PKG_FRAMESOURCE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // __linux__
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+/**
+ * @brief Where a Camera gets its images from
+ *
+ * @details read() is called in a loop by the capture thread of a Camera. Implementations
+ * should write into the given matrix so that its buffer is reused across frames.
+ */
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    /**
+     * @brief Check whether the source can deliver frames
+     *
+     * @return true if the source is usable
+     *         otherwise false
+     */
+    virtual bool isOpened() const = 0;
+
+    /**
+     * @brief Read the next frame, blocking until it is due
+     *
+     * @param img The output image, reallocated only if its size or type changes
+     * @return true if a frame was read
+     *         otherwise false
+     */
+    virtual bool read(cv::Mat& img) = 0;
+
+    /**
+     * @brief Check whether the source will never deliver a frame again
+     *
+     * @details E.g. a file played to its end without looping. A Camera stops its capture thread
+     * then instead of calling read() again.
+     */
+    virtual bool exhausted() const { return false; }
+
+    /**
+     * @brief Get the pixel format of the frames as a FOURCC code (e.g. a V4L2_PIX_FMT_* value)
+     *
+     * @details 0, the default, means the frames are BGR (or whatever their cv::Mat type says) and
+     * can go to the detectors as they are. Frames in another format need a conversion first,
+     * e.g. V4l2Source::to_bgr.
+     */
+    virtual uint32_t fourcc() const { return 0; }
+
+    /**
+     * @brief Release the underlying device or file
+     */
+    virtual void release() { }
+};
+
+/**
+ * @brief Delivers frames at a fixed rate
+ *
+ * @details A rate of 0 or less means as fast as possible. If the caller falls behind by more
+ * than a frame period, the schedule restarts from the current time instead of bursting.
+ */
+class FramePacer {
+    std::chrono::steady_clock::duration _period;
+    std::chrono::steady_clock::time_point _next;
+
+public:
+    /**
+     * @brief Construct a new FramePacer object
+     *
+     * @param fps Frames per second (0 for as fast as possible)
+     */
+    FramePacer(double fps = 0);
+
+    /**
+     * @brief Sleep until the next frame is due
+     */
+    void wait();
+};
+
+/**
+ * @brief A physical camera or a stream opened with cv::VideoCapture
+ */
+class VideoCaptureSource : public FrameSource {
+    cv::VideoCapture _cap;
+
+public:
+    /**
+     * @brief Open a camera by device index
+     *
+     * @param index Device index
+     * @param api Preferred OpenCV capture backend
+     */
+    VideoCaptureSource(int index, int api = cv::CAP_ANY);
+
+    /**
+     * @brief Open a camera by URL, stream or file name
+     *
+     * @param url Anything cv::VideoCapture accepts
+     * @param api Preferred OpenCV capture backend
+     */
+    VideoCaptureSource(const std::string& url, int api = cv::CAP_ANY);
+
+    bool isOpened() const override;
+    bool read(cv::Mat& img) override;
+    void release() override;
+};
+
+/**
+ * @brief Plays a video file or an image sequence (e.g. "frames/img_%04d.png")
+ */
+class FileSource : public FrameSource {
+    cv::VideoCapture _cap;
+    FramePacer _pacer;
+    bool _loop;
+    bool _ended;
+
+public:
+    /**
+     * @brief Open a video file or an image sequence
+     *
+     * @param path File name or printf-style image sequence pattern
+     * @param fps Playback rate (0 for as fast as possible)
+     * @param loop Restart from the first frame at the end of the file
+     */
+    FileSource(const std::string& path, double fps = 0, bool loop = true);
+
+    bool isOpened() const override;
+    bool read(cv::Mat& img) override;
+    bool exhausted() const override;
+    void release() override;
+};
+
+#ifdef __linux__
+/**
+ * @brief Plays a memory-mapped dump of raw, equally sized frames
+ *
+ * @details The file is a plain concatenation of frames of rows x cols x type without any header,
+ * e.g. written with fwrite(mat.data, 1, mat.total() * mat.elemSize(), f) for every frame.
+ */
+class RawFileSource : public FrameSource {
+    int _fd;
+    const uchar* _data;
+    size_t _file_size;
+    size_t _frame_size;
+    size_t _num_frames;
+    size_t _pos;
+    int _rows;
+    int _cols;
+    int _type;
+    FramePacer _pacer;
+    bool _loop;
+
+public:
+    /**
+     * @brief Map a raw frame dump
+     *
+     * @param path File name
+     * @param rows Frame height
+     * @param cols Frame width
+     * @param type Frame type (e.g. CV_8UC3)
+     * @param fps Playback rate (0 for as fast as possible)
+     * @param loop Restart from the first frame at the end of the file
+     */
+    RawFileSource(const std::string& path, int rows, int cols, int type = CV_8UC3,
+        double fps = 0, bool loop = true);
+
+    ~RawFileSource() override;
+
+    /**
+     * @brief Get the number of frames in the file
+     *
+     * @return size_t Number of frames
+     */
+    size_t size() const;
+
+    bool isOpened() const override;
+    bool read(cv::Mat& img) override;
+    bool exhausted() const override;
+    void release() override;
+
+    RawFileSource(const RawFileSource&) = delete;
+    RawFileSource& operator=(const RawFileSource&) = delete;
+};
+#endif // __linux__
+
+/**
+ * @brief Generates frames with filled colored circles at known positions
+ *
+ * @details Every circle moves with a constant velocity and bounces off the image borders, so the
+ * position of each circle in any frame is known exactly and runs are reproducible.
+ */
+class SyntheticSource : public FrameSource {
+public:
+    struct Circle {
+        /**
+         * @brief Center in the first frame
+         */
+        cv::Point center;
+
+        /**
+         * @brief Radius in pixels
+         */
+        int radius;
+
+        /**
+         * @brief BGR color
+         */
+        cv::Scalar color;
+
+        /**
+         * @brief Movement per frame in pixels
+         */
+        cv::Point velocity;
+    };
+
+private:
+    cv::Size _size;
+    cv::Scalar _background;
+    std::vector<Circle> _circles;
+    FramePacer _pacer;
+    uint64_t _index;
+
+public:
+    /**
+     * @brief Construct a new SyntheticSource object
+     *
+     * @param size Frame size
+     * @param circles Circles to draw
+     * @param fps Frame rate (0 for as fast as possible)
+     * @param background BGR background color
+     */
+    SyntheticSource(cv::Size size, std::vector<Circle> circles, double fps = 0,
+        cv::Scalar background = cv::Scalar(0, 0, 0));
+
+    /**
+     * @brief Get the circles as drawn in the given frame
+     *
+     * @param index Frame index, starting from 0
+     * @return std::vector<Circle> Circles with their centers in that frame
+     */
+    std::vector<Circle> circles_at(uint64_t index) const;
+
+    /**
+     * @brief Get the index of the next frame read() will produce
+     *
+     * @return uint64_t Frame index
+     */
+    uint64_t index() const;
+
+    /**
+     * @brief Draw the given frame
+     *
+     * @param index Frame index
+     * @param img The output image
+     */
+    void render(uint64_t index, cv::Mat& img) const;
+
+    bool isOpened() const override;
+    bool read(cv::Mat& img) override;
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline FramePacer::FramePacer(double fps)
+    : _period(fps > 0
+              ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                  std::chrono::duration<double>(1 / fps))
+              : std::chrono::steady_clock::duration::zero())
+    , _next(std::chrono::steady_clock::now())
+{
+}
+
+inline void FramePacer::wait()
+{
+    if (_period == std::chrono::steady_clock::duration::zero()) {
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (now > _next + _period) {
+        _next = now;
+    }
+    std::this_thread::sleep_until(_next);
+    _next += _period;
+}
+
+inline VideoCaptureSource::VideoCaptureSource(int index, int api)
+    : _cap(index, api)
+{
+}
+
+inline VideoCaptureSource::VideoCaptureSource(const std::string& url, int api)
+    : _cap(url, api)
+{
+}
+
+inline bool VideoCaptureSource::isOpened() const
+{
+    return _cap.isOpened();
+}
+
+inline bool VideoCaptureSource::read(cv::Mat& img)
+{
+    return _cap.read(img);
+}
+
+inline void VideoCaptureSource::release()
+{
+    _cap.release();
+}
+
+inline FileSource::FileSource(const std::string& path, double fps, bool loop)
+    : _cap(path)
+    , _pacer(fps)
+    , _loop(loop)
+    , _ended(false)
+{
+}
+
+inline bool FileSource::isOpened() const
+{
+    return _cap.isOpened();
+}
+
+inline bool FileSource::read(cv::Mat& img)
+{
+    _pacer.wait();
+    if (_cap.read(img)) {
+        return true;
+    }
+    if (!_loop || !_cap.set(cv::CAP_PROP_POS_FRAMES, 0) || !_cap.read(img)) {
+        _ended = true;
+        return false;
+    }
+    return true;
+}
+
+inline bool FileSource::exhausted() const
+{
+    return _ended;
+}
+
+inline void FileSource::release()
+{
+    _cap.release();
+}
+
+#ifdef __linux__
+inline RawFileSource::RawFileSource(const std::string& path, int rows, int cols, int type,
+    double fps, bool loop)
+    : _fd(-1)
+    , _data(nullptr)
+    , _file_size(0)
+    , _frame_size(static_cast<size_t>(rows) * cols * CV_ELEM_SIZE(type))
+    , _num_frames(0)
+    , _pos(0)
+    , _rows(rows)
+    , _cols(cols)
+    , _type(type)
+    , _pacer(fps)
+    , _loop(loop)
+{
+    if (_frame_size == 0) {
+        throw std::invalid_argument("Frame size must be positive.");
+    }
+    _fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (_fd < 0 || ::fstat(_fd, &st) != 0) {
+        release();
+        return;
+    }
+    _file_size = static_cast<size_t>(st.st_size);
+    _num_frames = _file_size / _frame_size;
+    if (_num_frames == 0) {
+        release();
+        return;
+    }
+    void* p = ::mmap(nullptr, _file_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (p == MAP_FAILED) {
+        release();
+        return;
+    }
+    _data = static_cast<const uchar*>(p);
+    ::madvise(p, _file_size, MADV_SEQUENTIAL);
+}
+
+inline RawFileSource::~RawFileSource()
+{
+    release();
+}
+
+inline size_t RawFileSource::size() const
+{
+    return _num_frames;
+}
+
+inline bool RawFileSource::isOpened() const
+{
+    return _data != nullptr;
+}
+
+inline bool RawFileSource::read(cv::Mat& img)
+{
+    if (!_data) {
+        return false;
+    }
+    if (_pos == _num_frames) {
+        if (!_loop) {
+            return false;
+        }
+        _pos = 0;
+    }
+    _pacer.wait();
+    img.create(_rows, _cols, _type);
+    const size_t row_size = static_cast<size_t>(_cols) * img.elemSize();
+    const uchar* src = _data + _pos++ * _frame_size;
+    if (img.isContinuous()) {
+        std::memcpy(img.data, src, _frame_size);
+    } else {
+        for (int y = 0; y < _rows; y++) {
+            std::memcpy(img.ptr(y), src + y * row_size, row_size);
+        }
+    }
+    return true;
+}
+
+inline bool RawFileSource::exhausted() const
+{
+    return !_data || (!_loop && _pos == _num_frames);
+}
+
+inline void RawFileSource::release()
+{
+    if (_data) {
+        ::munmap(const_cast<uchar*>(_data), _file_size);
+        _data = nullptr;
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+#endif // __linux__
+
+inline SyntheticSource::SyntheticSource(cv::Size size, std::vector<Circle> circles, double fps,
+    cv::Scalar background)
+    : _size(size)
+    , _background(background)
+    , _circles(std::move(circles))
+    , _pacer(fps)
+    , _index(0)
+{
+}
+
+inline std::vector<SyntheticSource::Circle> SyntheticSource::circles_at(uint64_t index) const
+{
+    // position along a path that reflects at both ends of [lo, hi]
+    auto bounce = [index](int start, int velocity, int lo, int hi) {
+        const int64_t span = hi - lo;
+        if (span <= 0) {
+            return lo;
+        }
+        int64_t p = (start - lo + static_cast<int64_t>(velocity) * static_cast<int64_t>(index))
+            % (2 * span);
+        if (p < 0) {
+            p += 2 * span;
+        }
+        return static_cast<int>(lo + (p <= span ? p : 2 * span - p));
+    };
+
+    std::vector<Circle> res = _circles;
+    for (Circle& c : res) {
+        c.center.x = bounce(c.center.x, c.velocity.x, c.radius, _size.width - 1 - c.radius);
+        c.center.y = bounce(c.center.y, c.velocity.y, c.radius, _size.height - 1 - c.radius);
+    }
+    return res;
+}
+
+inline uint64_t SyntheticSource::index() const
+{
+    return _index;
+}
+
+inline void SyntheticSource::render(uint64_t index, cv::Mat& img) const
+{
+    img.create(_size, CV_8UC3);
+    img.setTo(_background);
+    for (const Circle& c : circles_at(index)) {
+        cv::circle(img, c.center, c.radius, c.color, cv::FILLED);
+    }
+}
+
+inline bool SyntheticSource::isOpened() const
+{
+    return !_size.empty();
+}
+
+inline bool SyntheticSource::read(cv::Mat& img)
+{
+    _pacer.wait();
+    render(_index++, img);
+    return true;
+}
+
+#endif // INCLUDE_PKG_FRAMESOURCE_HPP
@@ -0,0 +1,478 @@
+#ifndef INCLUDE_PKG_LOGGER_HPP
+#define INCLUDE_PKG_LOGGER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <include_pkg/SpscRing.hpp>
+#include <include_pkg/general.hpp>
+
+/**
+ * @brief Asynchronous logging for the frame loop
+ *
+ * @details LOG_INFO("center %d %d", x, y) does not format anything: it copies the arguments into
+ * a fixed-size binary record and pushes it into a ring owned by the calling thread. A background
+ * thread formats the records with general::format and writes them to the console and/or a file.
+ * A producer never takes a lock or waits for I/O; when its ring is full the oldest record is
+ * dropped and counted.
+ *
+ * The format string must be a literal and is checked against the arguments at compile time.
+ * Records below LOG_LEVEL (0 debug ... 3 error, default 0) are compiled out, records below
+ * Logger::level() are skipped at run time.
+ */
+namespace logging {
+
+enum class Level {
+    Debug,
+    Info,
+    Warn,
+    Error
+};
+
+struct Record;
+
+/**
+ * @brief Static description of a log statement, its address is the format id of a record
+ */
+struct Site {
+    const char* format;
+    Level level;
+    const char* file;
+    int line;
+
+    /**
+     * @brief Decode the arguments of a record and format them
+     */
+    std::string (*render)(const Record&);
+};
+
+/**
+ * @brief A log statement with its arguments, copied by value through the rings
+ *
+ * @details Exactly two cache lines, aligned to them, so copying a record never touches a third.
+ */
+struct alignas(64) Record {
+    static constexpr size_t capacity = 104;
+
+    const Site* site;
+    int64_t time_ns;
+    uint32_t thread;
+    uint32_t size;
+    char data[capacity];
+};
+
+static_assert(sizeof(Record) == 128, "Record must fill exactly two cache lines.");
+
+class Logger {
+public:
+    struct Options {
+        /**
+         * @brief Write to std::cout
+         */
+        bool console = true;
+
+        /**
+         * @brief Also append to this file if not empty
+         */
+        std::string file;
+
+        /**
+         * @brief Number of records each thread can queue before dropping
+         */
+        size_t capacity = 1024;
+
+        /**
+         * @brief Sleep of the writer thread when every ring is empty
+         */
+        std::chrono::milliseconds idle { 2 };
+
+        /**
+         * @brief Construct a new Options object
+         */
+        Options() { }
+    };
+
+private:
+    // guards the sinks
+    std::mutex _sink_mutex;
+    Options _opt;
+    std::ofstream _file;
+
+    // guards the rings and the flush state
+    std::mutex _mutex;
+    std::vector<std::shared_ptr<SpscRing<Record>>> _rings;
+    std::atomic<uint32_t> _threads;
+    std::atomic<int> _level;
+
+    std::atomic<uint64_t> _flush_req;
+    uint64_t _flush_done;
+    std::condition_variable _cv;
+
+    std::atomic<bool> _running;
+    std::thread _t;
+
+    Logger();
+
+    void _write_forever();
+
+    /**
+     * @brief Write every queued record
+     *
+     * @return size_t Number of records written
+     */
+    size_t _drain(std::string& line);
+
+public:
+    ~Logger();
+
+    static Logger& instance();
+
+    /**
+     * @brief Change the sinks and the queue size for threads that log for the first time
+     */
+    void configure(const Options& opt);
+
+    void set_level(Level level);
+    Level level() const;
+
+    bool enabled(Level level) const;
+
+    /**
+     * @brief Get the ring of the calling thread, creating it on the first call
+     */
+    SpscRing<Record>& ring();
+
+    /**
+     * @brief Get the id of the calling thread used in the records
+     */
+    uint32_t thread_id();
+
+    /**
+     * @brief Wait until the records queued before the call are written
+     */
+    void flush();
+
+    /**
+     * @brief Get the number of records dropped because a ring was full
+     */
+    uint64_t dropped();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+};
+
+namespace detail {
+
+    template <typename T>
+    struct is_string
+        : std::integral_constant<bool,
+              std::is_same<T, const char*>::value || std::is_same<T, char*>::value
+                  || std::is_same<T, std::string>::value> {
+    };
+
+    inline const char* c_str(const char* s)
+    {
+        return s ? s : "(null)";
+    }
+
+    inline const char* c_str(const std::string& s)
+    {
+        return s.c_str();
+    }
+
+    /**
+     * @brief Bytes an argument needs at least; a string needs its terminating null
+     */
+    template <typename T>
+    constexpr size_t fixed_size()
+    {
+        return is_string<T>::value ? 1 : sizeof(T);
+    }
+
+    // strings are copied with their terminating null, cut so that the arguments after them fit
+    template <typename T, std::enable_if_t<is_string<T>::value, int> = 0>
+    inline void encode(Record& r, const T& x, size_t& reserved)
+    {
+        reserved -= 1;
+        const char* s = c_str(x);
+        const size_t n = std::min(std::strlen(s), Record::capacity - r.size - reserved - 1);
+        std::memcpy(r.data + r.size, s, n);
+        r.data[r.size + n] = '\0';
+        r.size += static_cast<uint32_t>(n + 1);
+    }
+
+    template <typename T, std::enable_if_t<!is_string<T>::value, int> = 0>
+    inline void encode(Record& r, const T& x, size_t& reserved)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Log arguments must be trivially copyable.");
+        reserved -= sizeof(T);
+        std::memcpy(r.data + r.size, &x, sizeof(T));
+        r.size += sizeof(T);
+    }
+
+    template <typename T, std::enable_if_t<is_string<T>::value, int> = 0>
+    inline const char* decode(const Record& r, size_t& off)
+    {
+        const char* s = r.data + off;
+        off += std::strlen(s) + 1;
+        return s;
+    }
+
+    template <typename T, std::enable_if_t<!is_string<T>::value, int> = 0>
+    inline T decode(const Record& r, size_t& off)
+    {
+        T x;
+        std::memcpy(&x, r.data + off, sizeof(T));
+        off += sizeof(T);
+        return x;
+    }
+
+    template <typename List>
+    struct Codec;
+
+    template <typename... T>
+    struct Codec<general::detail::type_list<T...>> {
+        static_assert((fixed_size<T>() + ... + 0) <= Record::capacity,
+            "Too many log arguments for one record.");
+
+        template <typename... Args>
+        static void encode_all(Record& r, const Args&... args)
+        {
+            size_t reserved = (fixed_size<T>() + ... + 0);
+            (encode<T>(r, args, reserved), ...);
+            (void)reserved;
+        }
+
+        static std::string render(const Record& r)
+        {
+            size_t off = 0;
+            // a braced list is evaluated left to right
+            const std::tuple<decltype(decode<T>(r, off))...> args { decode<T>(r, off)... };
+            return std::apply(
+                [&](const auto&... a) { return general::format(r.site->format, a...); }, args);
+        }
+    };
+
+    inline int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // the format string is already in the site
+    template <typename List, typename... Args>
+    inline void push(const Site* site, const char*, const Args&... args)
+    {
+        Record r;
+        Logger& log = Logger::instance();
+        r.site = site;
+        r.time_ns = now_ns();
+        r.thread = log.thread_id();
+        r.size = 0;
+        Codec<List>::encode_all(r, args...);
+        log.ring().push(r);
+    }
+
+    inline const char* level_name(Level level)
+    {
+        switch (level) {
+        case Level::Debug: return "DEBUG";
+        case Level::Info: return "INFO";
+        case Level::Warn: return "WARN";
+        default: return "ERROR";
+        }
+    }
+
+} // namespace detail
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline Logger::Logger()
+    : _threads(0)
+    , _level(static_cast<int>(Level::Debug))
+    , _flush_req(0)
+    , _flush_done(0)
+    , _running(true)
+{
+    _t = std::thread(&Logger::_write_forever, this);
+}
+
+inline Logger::~Logger()
+{
+    flush();
+    _running = false;
+    _cv.notify_all();
+    _t.join();
+}
+
+inline Logger& Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+inline void Logger::configure(const Options& opt)
+{
+    std::lock_guard<std::mutex> sinks(_sink_mutex);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _opt = opt;
+    _file.close();
+    if (!_opt.file.empty()) {
+        _file.open(_opt.file, std::ios::app);
+    }
+}
+
+inline void Logger::set_level(Level level)
+{
+    _level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+inline Level Logger::level() const
+{
+    return static_cast<Level>(_level.load(std::memory_order_relaxed));
+}
+
+inline bool Logger::enabled(Level level) const
+{
+    return static_cast<int>(level) >= _level.load(std::memory_order_relaxed);
+}
+
+inline SpscRing<Record>& Logger::ring()
+{
+    thread_local SpscRing<Record>* ring = [this] {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _rings.emplace_back(new SpscRing<Record>(_opt.capacity, SpscRing<Record>::Overflow::DropOldest));
+        return _rings.back().get();
+    }();
+    return *ring;
+}
+
+inline uint32_t Logger::thread_id()
+{
+    thread_local const uint32_t id = _threads.fetch_add(1);
+    return id;
+}
+
+inline uint64_t Logger::dropped()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint64_t n = 0;
+    for (const std::shared_ptr<SpscRing<Record>>& r : _rings) {
+        n += r->dropped();
+    }
+    return n;
+}
+
+inline void Logger::flush()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    const uint64_t req = _flush_req.fetch_add(1) + 1;
+    _cv.notify_all();
+    _cv.wait(lock, [&] { return _flush_done >= req || !_running.load(); });
+}
+
+inline size_t Logger::_drain(std::string& line)
+{
+    // the rings are only appended to, so a snapshot of the pointers is enough
+    std::vector<SpscRing<Record>*> rings;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const std::shared_ptr<SpscRing<Record>>& r : _rings) {
+            rings.push_back(r.get());
+        }
+    }
+
+    std::lock_guard<std::mutex> sinks(_sink_mutex);
+    size_t written = 0;
+    Record r;
+    for (SpscRing<Record>* ring : rings) {
+        while (ring->try_pop(r)) {
+            const std::time_t secs = static_cast<std::time_t>(r.time_ns / 1000000000);
+            char stamp[32];
+            std::strftime(stamp, sizeof(stamp), "%H:%M:%S", std::localtime(&secs));
+            line = general::format("%s.%06d [%s] T%u %s:%d ", stamp,
+                static_cast<int>(r.time_ns / 1000 % 1000000), detail::level_name(r.site->level),
+                r.thread, r.site->file, r.site->line);
+            line += r.site->render(r);
+            line += '\n';
+            if (_opt.console) {
+                std::cout << line;
+            }
+            if (_file.is_open()) {
+                _file << line;
+            }
+            written++;
+        }
+    }
+    if (written > 0) {
+        std::cout.flush();
+        if (_file.is_open()) {
+            _file.flush();
+        }
+    }
+    return written;
+}
+
+inline void Logger::_write_forever()
+{
+    std::string line;
+    while (true) {
+        const uint64_t req = _flush_req.load();
+        const bool running = _running.load();
+        if (_drain(line) > 0) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        // every ring was empty after the request was seen
+        _flush_done = req;
+        _cv.notify_all();
+        if (!running) {
+            return;
+        }
+        _cv.wait_for(lock, _opt.idle, [&] { return _flush_req.load() != req || !_running.load(); });
+    }
+}
+
+} // namespace logging
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 0
+#endif
+
+// the format string is the first of __VA_ARGS__, so a call without arguments is valid before C++20
+#define LOG_AT(lvl, ...)                                                                                 \
+    do {                                                                                                 \
+        using __log_args = decltype(::general::detail::tail_types(__VA_ARGS__));                         \
+        static_assert(::general::detail::check_format(GENERAL_DETAIL_FIRST(__VA_ARGS__), __log_args {}), \
+            "format string does not match the argument types");                                         \
+        if (static_cast<int>(lvl) >= LOG_LEVEL && ::logging::Logger::instance().enabled(lvl)) {         \
+            static const ::logging::Site __log_site = { GENERAL_DETAIL_FIRST(__VA_ARGS__), lvl,          \
+                __FILE__, __LINE__, &::logging::detail::Codec<__log_args>::render };                     \
+            ::logging::detail::push<__log_args>(&__log_site, __VA_ARGS__);                               \
+        }                                                                                                \
+    } while (false)
+
+#define LOG_DEBUG(...) LOG_AT(::logging::Level::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(::logging::Level::Info, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(::logging::Level::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(::logging::Level::Error, __VA_ARGS__)
+
+#endif // INCLUDE_PKG_LOGGER_HPP
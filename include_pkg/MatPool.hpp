@@ -0,0 +1,390 @@
+#ifndef INCLUDE_PKG_MATPOOL_HPP
+#define INCLUDE_PKG_MATPOOL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif // __linux__
+
+#include <opencv2/core.hpp>
+
+/**
+ * @brief cv::Mat allocator that carves buffers out of one region reserved up front
+ *
+ * @details The region is mapped once, with huge pages if the system has them reserved and with
+ * transparent huge pages otherwise. Requests are rounded up to a size class (four classes per
+ * power of two, so at most 25% is wasted) and served from the free list of the class, or carved
+ * from the unused end of the region the first time a class is needed. Freed buffers go back to
+ * the free list of their class and are never returned to the system, so a program that keeps
+ * allocating the same frame sizes reaches a fixed footprint after the first frames and stays
+ * there, without fragmenting the general-purpose heap. Requests that do not fit in the region
+ * any more are served by cv::fastMalloc and counted as misses.
+ *
+ * Give it to a Camera (Camera::Options::allocator), to a DetectorContext, to single matrices
+ * (cv::Mat::allocator) or to every matrix with cv::Mat::setDefaultAllocator. The pool must
+ * outlive every matrix allocated from it.
+ */
+class MatPool : public cv::MatAllocator {
+public:
+    struct Options {
+        /**
+         * @brief Size of the region in bytes, rounded up to 2 MiB
+         */
+        size_t capacity = size_t(256) << 20;
+
+        /**
+         * @brief Try to map the region with explicit huge pages (MAP_HUGETLB) first
+         */
+        bool huge_pages = true;
+
+        /**
+         * @brief Fault every page of the region in when it is mapped, so none faults while running
+         */
+        bool populate = false;
+
+        /**
+         * @brief Construct a new Options object
+         */
+        Options() { }
+
+        /**
+         * @brief Check whether the parameters in Options struct is valid
+         *
+         * @return true if all the parameters are valid
+         *         otherwise false
+         */
+        bool check() const;
+    };
+
+    struct Stats {
+        /**
+         * @brief Size of the region in bytes
+         */
+        size_t capacity = 0;
+
+        /**
+         * @brief Bytes of the region carved into buffers so far
+         */
+        size_t reserved = 0;
+
+        /**
+         * @brief Bytes of the buffers currently in use, by size class
+         */
+        size_t in_use = 0;
+
+        /**
+         * @brief Largest in_use seen
+         */
+        size_t high_water = 0;
+
+        /**
+         * @brief Number of buffers handed out, including misses
+         */
+        uint64_t allocations = 0;
+
+        /**
+         * @brief Number of buffers that did not fit in the region and came from the heap
+         */
+        uint64_t misses = 0;
+
+        /**
+         * @brief Whether the region is backed by explicit huge pages
+         */
+        bool huge_pages = false;
+    };
+
+private:
+    static constexpr size_t _alignment = size_t(2) << 20;
+    static constexpr size_t _classes = 256;
+
+    Options _opt;
+    uchar* _base;
+    size_t _capacity;
+    bool _mapped;
+
+    mutable std::mutex _m;
+    mutable size_t _top;
+    mutable void* _free[_classes];
+    mutable Stats _stats;
+
+    /**
+     * @brief Round a request up to its size class
+     *
+     * @param size Requested bytes
+     * @param index The index of the class
+     * @return size_t The size of the class
+     */
+    static size_t _class_size(size_t size, size_t& index);
+
+    /**
+     * @brief Get the size of a size class
+     */
+    static size_t _size_of(size_t index);
+
+    /**
+     * @brief Get a buffer of a size class from the region
+     *
+     * @details If the class has no free buffer and the region is full, a free buffer of one of
+     * the next four classes (at most twice the size) is used instead, and size and index are
+     * updated to its class.
+     *
+     * @return void* The buffer, or nullptr if the region is exhausted
+     */
+    void* _take(size_t& size, size_t& index) const;
+
+public:
+    /**
+     * @brief Map the region
+     *
+     * @param opt Pool options
+     */
+    explicit MatPool(const Options& opt = Options());
+
+    /**
+     * @brief Unmap the region; every matrix allocated from the pool must be gone
+     */
+    ~MatPool();
+
+    /**
+     * @brief Get the shared pool with the default options
+     *
+     * @details The pool is never destroyed, so matrices with static storage may use it too.
+     */
+    static MatPool& global();
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+        cv::AccessFlag flags, cv::UMatUsageFlags usage) const override;
+    bool allocate(cv::UMatData* data, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+    /**
+     * @brief Get a snapshot of the pool statistics
+     */
+    Stats stats() const;
+
+    /**
+     * @brief Print the pool statistics in a single line
+     */
+    void print_stats(std::ostream& os = std::cout) const;
+
+    MatPool(const MatPool&) = delete;
+    MatPool& operator=(const MatPool&) = delete;
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline bool MatPool::Options::check() const
+{
+    return capacity > 0;
+}
+
+inline MatPool::MatPool(const Options& opt)
+    : _opt(opt)
+    , _base(nullptr)
+    , _capacity(0)
+    , _mapped(false)
+    , _top(0)
+{
+    if (!_opt.check()) {
+        throw std::invalid_argument("Invalid mat pool options.");
+    }
+    std::fill(_free, _free + _classes, nullptr);
+    _capacity = (_opt.capacity + _alignment - 1) / _alignment * _alignment;
+
+#ifdef __linux__
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (_opt.populate) {
+        flags |= MAP_POPULATE;
+    }
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (_opt.huge_pages) {
+        p = mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        _stats.huge_pages = p != MAP_FAILED;
+    }
+#endif // MAP_HUGETLB
+    if (p == MAP_FAILED) {
+        p = mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, flags, -1, 0);
+#ifdef MADV_HUGEPAGE
+        if (p != MAP_FAILED) {
+            madvise(p, _capacity, MADV_HUGEPAGE);
+        }
+#endif // MADV_HUGEPAGE
+    }
+    if (p != MAP_FAILED) {
+        _base = static_cast<uchar*>(p);
+        _mapped = true;
+    }
+#endif // __linux__
+    if (!_base) {
+        _base = static_cast<uchar*>(std::aligned_alloc(_alignment, _capacity));
+    }
+    if (!_base) {
+        throw std::runtime_error("MatPool could not reserve its region.");
+    }
+    _stats.capacity = _capacity;
+}
+
+inline MatPool::~MatPool()
+{
+#ifdef __linux__
+    if (_mapped) {
+        munmap(_base, _capacity);
+        return;
+    }
+#endif // __linux__
+    std::free(_base);
+}
+
+inline MatPool& MatPool::global()
+{
+    static MatPool* pool = new MatPool();
+    return *pool;
+}
+
+inline size_t MatPool::_class_size(size_t size, size_t& index)
+{
+    if (size <= 256) {
+        index = 0;
+        return 256;
+    }
+    // size is in (2^k, 2^(k+1)]; the classes in between are 2^k + j * 2^(k-2) for j = 1..4
+    const int k = 63 - __builtin_clzll(static_cast<unsigned long long>(size - 1));
+    const size_t step = size_t(1) << (k - 2);
+    const size_t rounded = (size + step - 1) & ~(step - 1);
+    index = 1 + static_cast<size_t>(k - 8) * 4 + (rounded >> (k - 2)) - 5;
+    return rounded;
+}
+
+inline size_t MatPool::_size_of(size_t index)
+{
+    if (index == 0) {
+        return 256;
+    }
+    const size_t k = 8 + (index - 1) / 4;
+    return (size_t(1) << k) + ((index - 1) % 4 + 1) * (size_t(1) << (k - 2));
+}
+
+inline void* MatPool::_take(size_t& size, size_t& index) const
+{
+    if (index >= _classes) {
+        return nullptr;
+    }
+    if (!_free[index] && size <= _capacity - _top) {
+        void* p = _base + _top;
+        _top += size;
+        _stats.reserved = _top;
+        return p;
+    }
+    for (size_t i = index; i < std::min(index + 5, _classes); i++) {
+        if (_free[i]) {
+            void* p = _free[i];
+            std::memcpy(&_free[i], p, sizeof(void*));
+            index = i;
+            size = _size_of(i);
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+inline cv::UMatData* MatPool::allocate(int dims, const int* sizes, int type, void* data0,
+    size_t* step, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    // same layout as OpenCV's standard allocator
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step) {
+            if (data0 && step[i] != CV_AUTOSTEP) {
+                total = step[i];
+            } else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    cv::UMatData* u = new cv::UMatData(this);
+    u->size = total;
+    if (data0) {
+        u->data = u->origdata = static_cast<uchar*>(data0);
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+        return u;
+    }
+
+    size_t index;
+    size_t size = _class_size(total, index);
+    void* p;
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        p = _take(size, index);
+        _stats.allocations++;
+        if (p) {
+            _stats.in_use += size;
+            _stats.high_water = std::max(_stats.high_water, _stats.in_use);
+        } else {
+            _stats.misses++;
+        }
+    }
+    if (p) {
+        // the class is kept for deallocate, 0 marks a buffer from the heap
+        u->allocatorFlags_ = static_cast<int>(index) + 1;
+    } else {
+        p = cv::fastMalloc(total);
+    }
+    u->data = u->origdata = static_cast<uchar*>(p);
+    return u;
+}
+
+inline bool MatPool::allocate(cv::UMatData* u, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    return u != nullptr;
+}
+
+inline void MatPool::deallocate(cv::UMatData* u) const
+{
+    if (!u) {
+        return;
+    }
+    if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+        if (u->allocatorFlags_ > 0) {
+            const size_t index = static_cast<size_t>(u->allocatorFlags_) - 1;
+            const size_t size = _size_of(index);
+            std::lock_guard<std::mutex> lock(_m);
+            std::memcpy(u->origdata, &_free[index], sizeof(void*));
+            _free[index] = u->origdata;
+            _stats.in_use -= size;
+        } else {
+            cv::fastFree(u->origdata);
+        }
+        u->origdata = nullptr;
+    }
+    delete u;
+}
+
+inline MatPool::Stats MatPool::stats() const
+{
+    std::lock_guard<std::mutex> lock(_m);
+    return _stats;
+}
+
+inline void MatPool::print_stats(std::ostream& os) const
+{
+    const Stats s = stats();
+    os << "MatPool: " << (s.in_use >> 20) << " MiB in use, high water " << (s.high_water >> 20)
+       << " MiB, reserved " << (s.reserved >> 20) << " / " << (s.capacity >> 20) << " MiB, "
+       << s.allocations << " allocations, " << s.misses << " misses"
+       << (s.huge_pages ? ", huge pages" : "") << std::endl;
+}
+
+#endif // INCLUDE_PKG_MATPOOL_HPP
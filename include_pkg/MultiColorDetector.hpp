@@ -0,0 +1,278 @@
+#ifndef INCLUDE_PKG_MULTICOLORDETECTOR_HPP
+#define INCLUDE_PKG_MULTICOLORDETECTOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <include_pkg/Profiler.hpp>
+#include <include_pkg/blob.hpp>
+#include <include_pkg/hsv.hpp>
+
+/**
+ * @brief Finds the biggest groups of several colors in a single pass over the image
+ *
+ * @details Every HSV box is a product of a hue, a saturation and a value interval, so it is
+ * stored as one bit in three tables indexed by H, S and V. A pixel is converted to HSV once and
+ * the three looked up bit sets are ANDed, which tests it against all colors at the same time.
+ * The lowest numbered matching color is written to a class map (0 for none), and all classes
+ * are labeled together by BlobLabeler::label_values. The cost grows with the number of groups,
+ * not with the number of colors. The HSV conversion is shared with hsv::threshold and uses AVX2
+ * or SSE4.1 when available.
+ */
+class MultiColorDetector {
+public:
+    /**
+     * @brief Maximum number of colors, one bit each in the tables
+     */
+    static constexpr size_t max_colors = 32;
+
+private:
+    std::vector<hsv::Bounds> _bounds;
+    size_t _top_k;
+    int64_t _min_area;
+
+    uint32_t _h[256];
+    uint32_t _s[256];
+    uint32_t _v[256];
+
+    cv::Mat _classes;
+    BlobLabeler _labeler;
+    std::vector<std::vector<Blob>> _found;
+
+    void _classify_row(const uchar* src, uchar* dst, int cols) const;
+
+    /**
+     * @brief Classify the longest prefix of a row the SIMD path can do
+     *
+     * @return int Number of pixels classified
+     */
+    int _classify_row_simd(const uchar* src, uchar* dst, int cols) const;
+
+public:
+    /**
+     * @brief Construct a new MultiColorDetector object
+     *
+     * @param params Color detection parameters of every color, as returned by read_params
+     * @param top_k Number of groups kept per color, biggest first
+     * @param min_area Groups smaller than this many pixels are ignored
+     */
+    explicit MultiColorDetector(const std::vector<std::tuple<cv::Scalar, int, int, int>>& params,
+        size_t top_k = 1, int64_t min_area = 1);
+
+    /**
+     * @brief Construct a new MultiColorDetector object from HSV boxes
+     *
+     * @param bounds Accepted HSV box of every color; if boxes overlap, the first one wins
+     * @param top_k Number of groups kept per color, biggest first
+     * @param min_area Groups smaller than this many pixels are ignored
+     */
+    explicit MultiColorDetector(const std::vector<hsv::Bounds>& bounds,
+        size_t top_k = 1, int64_t min_area = 1);
+
+    /**
+     * @brief Find the biggest groups of every color
+     *
+     * @param image The input BGR image
+     * @return const std::vector<std::vector<Blob>>& For every color, in the order given, up to
+     *         top_k groups sorted by decreasing area; valid until the next call
+     */
+    const std::vector<std::vector<Blob>>& detect(const cv::Mat& image);
+
+    /**
+     * @brief Get the class map of the last image, 1 + index of the color of each pixel or 0
+     */
+    const cv::Mat& classes() const;
+
+    /**
+     * @brief Get the number of colors
+     */
+    size_t colors() const;
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline MultiColorDetector::MultiColorDetector(
+    const std::vector<std::tuple<cv::Scalar, int, int, int>>& params, size_t top_k, int64_t min_area)
+    : MultiColorDetector(
+        [&params] {
+            std::vector<hsv::Bounds> bounds;
+            for (const auto& p : params) {
+                bounds.push_back(hsv::make_bounds(std::get<0>(p), std::get<1>(p),
+                    std::get<2>(p), std::get<3>(p)));
+            }
+            return bounds;
+        }(),
+        top_k, min_area)
+{
+}
+
+inline MultiColorDetector::MultiColorDetector(const std::vector<hsv::Bounds>& bounds,
+    size_t top_k, int64_t min_area)
+    : _bounds(bounds)
+    , _top_k(top_k)
+    , _min_area(min_area)
+    , _found(bounds.size())
+{
+    if (_bounds.empty() || _bounds.size() > max_colors) {
+        throw std::invalid_argument("MultiColorDetector expects between 1 and 32 colors.");
+    }
+    if (_top_k == 0 || _min_area < 1) {
+        throw std::invalid_argument("Invalid multi color detector options.");
+    }
+    std::fill(_h, _h + 256, 0u);
+    std::fill(_s, _s + 256, 0u);
+    std::fill(_v, _v + 256, 0u);
+    for (size_t c = 0; c < _bounds.size(); c++) {
+        const hsv::Bounds& b = _bounds[c];
+        const uint32_t bit = uint32_t(1) << c;
+        for (int i = 0; i < 256; i++) {
+            const bool hue_ok = b.wraps() ? (i >= b.h_lo || i <= b.h_hi) : (i >= b.h_lo && i <= b.h_hi);
+            // hue never reaches 180 and above
+            if (hue_ok && i < 180) {
+                _h[i] |= bit;
+            }
+            if (i >= b.s_lo && i <= b.s_hi) {
+                _s[i] |= bit;
+            }
+            if (i >= b.v_lo && i <= b.v_hi) {
+                _v[i] |= bit;
+            }
+        }
+    }
+}
+
+inline size_t MultiColorDetector::colors() const
+{
+    return _bounds.size();
+}
+
+inline const cv::Mat& MultiColorDetector::classes() const
+{
+    return _classes;
+}
+
+#if defined(__AVX2__)
+inline int MultiColorDetector::_classify_row_simd(const uchar* src, uchar* dst, int cols) const
+{
+    const hsv::detail::Tables& t = hsv::detail::tables();
+    const int* h_bits = reinterpret_cast<const int*>(_h);
+    const int* s_bits = reinterpret_cast<const int*>(_s);
+    const int* v_bits = reinterpret_cast<const int*>(_v);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i exponent = _mm256_set1_epi32(0xff);
+    const __m256i bias = _mm256_set1_epi32(126);
+
+    int x = 0;
+    for (; x + 10 <= cols; x += 8) {
+        __m256i h, s, v;
+        hsv::detail::hsv_simd(t, src + 3 * x, h, s, v);
+        __m256i bits = _mm256_and_si256(_mm256_i32gather_epi32(h_bits, h, 4),
+            _mm256_and_si256(_mm256_i32gather_epi32(s_bits, s, 4), _mm256_i32gather_epi32(v_bits, v, 4)));
+
+        // index of the lowest set bit from the float exponent of that bit alone, plus one
+        bits = _mm256_and_si256(bits, _mm256_sub_epi32(zero, bits));
+        const __m256i e = _mm256_and_si256(_mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(bits)), 23), exponent);
+        const __m256i c = _mm256_andnot_si256(_mm256_cmpeq_epi32(bits, zero), _mm256_sub_epi32(e, bias));
+
+        const __m128i c16 = _mm_packus_epi32(_mm256_castsi256_si128(c), _mm256_extracti128_si256(c, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(c16, c16));
+    }
+    return x;
+}
+#elif defined(__SSE4_1__)
+inline int MultiColorDetector::_classify_row_simd(const uchar* src, uchar* dst, int cols) const
+{
+    const hsv::detail::Tables& t = hsv::detail::tables();
+    int x = 0;
+    for (; x + 6 <= cols; x += 4) {
+        __m128i h, s, v;
+        hsv::detail::hsv_simd(t, src + 3 * x, h, s, v);
+        alignas(16) int hh[4], ss[4], vv[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(hh), h);
+        _mm_store_si128(reinterpret_cast<__m128i*>(ss), s);
+        _mm_store_si128(reinterpret_cast<__m128i*>(vv), v);
+        for (int i = 0; i < 4; i++) {
+            uint32_t bits = _h[hh[i]] & _s[ss[i]] & _v[vv[i]];
+            uchar c = 0;
+            if (bits != 0) {
+                for (c = 1; (bits & 1) == 0; c++) {
+                    bits >>= 1;
+                }
+            }
+            dst[x + i] = c;
+        }
+    }
+    return x;
+}
+#else
+inline int MultiColorDetector::_classify_row_simd(const uchar*, uchar*, int) const
+{
+    return 0;
+}
+#endif
+
+inline void MultiColorDetector::_classify_row(const uchar* src, uchar* dst, int cols) const
+{
+    const hsv::detail::Tables& t = hsv::detail::tables();
+    for (int x = _classify_row_simd(src, dst, cols); x < cols; x++) {
+        int h, s, v;
+        hsv::detail::hsv_scalar(t, src[3 * x], src[3 * x + 1], src[3 * x + 2], h, s, v);
+        uint32_t bits = _h[h] & _s[s] & _v[v];
+        uchar c = 0;
+        if (bits != 0) {
+            for (c = 1; (bits & 1) == 0; c++) {
+                bits >>= 1;
+            }
+        }
+        dst[x] = c;
+    }
+}
+
+inline const std::vector<std::vector<Blob>>& MultiColorDetector::detect(const cv::Mat& image)
+{
+    PROFILE_SCOPE("multi_color_detect");
+    if (image.type() != CV_8UC3) {
+        throw std::invalid_argument("MultiColorDetector expects an 8-bit BGR image.");
+    }
+    _classes.create(image.rows, image.cols, CV_8UC1);
+    {
+        PROFILE_SCOPE("multi_color_classify");
+        for (int y = 0; y < image.rows; y++) {
+            _classify_row(image.ptr<uchar>(y), _classes.ptr<uchar>(y), image.cols);
+        }
+    }
+
+    PROFILE_SCOPE("multi_color_label");
+    const std::vector<Blob>& blobs = _labeler.label_values(_classes);
+    const std::vector<uchar>& values = _labeler.values();
+    for (std::vector<Blob>& found : _found) {
+        found.clear();
+    }
+    for (size_t i = 0; i < blobs.size(); i++) {
+        if (blobs[i].cnt < _min_area) {
+            continue;
+        }
+        // keep the top_k biggest in a small sorted list
+        std::vector<Blob>& found = _found[values[i] - 1];
+        if (found.size() == _top_k && found.back().cnt >= blobs[i].cnt) {
+            continue;
+        }
+        if (found.size() == _top_k) {
+            found.pop_back();
+        }
+        auto at = std::upper_bound(found.begin(), found.end(), blobs[i],
+            [](const Blob& a, const Blob& b) { return a.cnt > b.cnt; });
+        found.insert(at, blobs[i]);
+    }
+    return _found;
+}
+
+#endif // INCLUDE_PKG_MULTICOLORDETECTOR_HPP
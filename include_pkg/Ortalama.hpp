@@ -1,26 +1,447 @@
 #ifndef ORTALAMA_HPP
 #define ORTALAMA_HPP
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
-#include <queue>
+#include <memory>
+#include <type_traits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ortalama_detail {
+
+/**
+ * @brief Running sum of integers, exact in a 64-bit accumulator
+ */
+template <class T, bool = std::is_integral<T>::value>
+class Sum {
+    using Acc = typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type;
+    Acc _sum = 0;
+
+public:
+    void add(T x) { _sum += x; }
+    void sub(T x) { _sum -= x; }
+    T mean(size_t n) const { return static_cast<T>(_sum / static_cast<Acc>(n)); }
+    void reset() { _sum = 0; }
+};
+
+/**
+ * @brief Running sum of floating point values with Kahan compensation
+ *
+ * @note Compensation is optimized away by -ffast-math.
+ */
+template <class T>
+class Sum<T, false> {
+    T _sum = 0;
+    T _c = 0;
+
+    void _add(T y)
+    {
+        y -= _c;
+        const T t = _sum + y;
+        _c = (t - _sum) - y;
+        _sum = t;
+    }
+
+public:
+    void add(T x) { _add(x); }
+    void sub(T x) { _add(-x); }
+    T mean(size_t n) const { return _sum / static_cast<T>(n); }
+    void reset() { _sum = _c = 0; }
+};
+
+/**
+ * @brief Window storage with the size fixed at compile time
+ */
+template <class T, size_t W>
+class Window {
+    std::array<T, W> _buf;
+
+public:
+    explicit Window(size_t) { }
+    T* data() { return _buf.data(); }
+    const T* data() const { return _buf.data(); }
+    constexpr size_t size() const { return W; }
+};
+
+/**
+ * @brief Window storage with the size given at construction
+ */
+template <class T>
+class Window<T, 0> {
+    std::unique_ptr<T[]> _buf;
+    size_t _n;
+
+public:
+    explicit Window(size_t n)
+        : _buf(new T[n])
+        , _n(n)
+    {
+    }
+    T* data() { return _buf.get(); }
+    const T* data() const { return _buf.get(); }
+    size_t size() const { return _n; }
+};
+
+// the SIMD kernels return the number of channels they updated, the rest is left to the scalar loop
+#if defined(__AVX__)
+inline int welford_grow_simd(double* mean, double* m2, const double* x, double inv, int n)
+{
+    const __m256d k = _mm256_set1_pd(inv);
+    int c = 0;
+    for (; c + 4 <= n; c += 4) {
+        const __m256d xv = _mm256_loadu_pd(x + c);
+        __m256d mv = _mm256_loadu_pd(mean + c);
+        const __m256d d = _mm256_sub_pd(xv, mv);
+        mv = _mm256_add_pd(mv, _mm256_mul_pd(d, k));
+        _mm256_storeu_pd(mean + c, mv);
+        _mm256_storeu_pd(m2 + c, _mm256_add_pd(_mm256_loadu_pd(m2 + c),
+                                     _mm256_mul_pd(d, _mm256_sub_pd(xv, mv))));
+    }
+    return c;
+}
+
+inline int welford_slide_simd(double* mean, double* m2, const double* x, const double* xo,
+    double inv, int n)
+{
+    const __m256d k = _mm256_set1_pd(inv);
+    int c = 0;
+    for (; c + 4 <= n; c += 4) {
+        const __m256d xv = _mm256_loadu_pd(x + c), ov = _mm256_loadu_pd(xo + c);
+        const __m256d mo = _mm256_loadu_pd(mean + c);
+        const __m256d d = _mm256_sub_pd(xv, ov);
+        const __m256d mv = _mm256_add_pd(mo, _mm256_mul_pd(d, k));
+        _mm256_storeu_pd(mean + c, mv);
+        const __m256d e = _mm256_add_pd(_mm256_sub_pd(xv, mv), _mm256_sub_pd(ov, mo));
+        _mm256_storeu_pd(m2 + c, _mm256_add_pd(_mm256_loadu_pd(m2 + c), _mm256_mul_pd(d, e)));
+    }
+    return c;
+}
+#elif defined(__SSE2__)
+inline int welford_grow_simd(double* mean, double* m2, const double* x, double inv, int n)
+{
+    const __m128d k = _mm_set1_pd(inv);
+    int c = 0;
+    for (; c + 2 <= n; c += 2) {
+        const __m128d xv = _mm_loadu_pd(x + c);
+        __m128d mv = _mm_loadu_pd(mean + c);
+        const __m128d d = _mm_sub_pd(xv, mv);
+        mv = _mm_add_pd(mv, _mm_mul_pd(d, k));
+        _mm_storeu_pd(mean + c, mv);
+        _mm_storeu_pd(m2 + c, _mm_add_pd(_mm_loadu_pd(m2 + c), _mm_mul_pd(d, _mm_sub_pd(xv, mv))));
+    }
+    return c;
+}
+
+inline int welford_slide_simd(double* mean, double* m2, const double* x, const double* xo,
+    double inv, int n)
+{
+    const __m128d k = _mm_set1_pd(inv);
+    int c = 0;
+    for (; c + 2 <= n; c += 2) {
+        const __m128d xv = _mm_loadu_pd(x + c), ov = _mm_loadu_pd(xo + c);
+        const __m128d mo = _mm_loadu_pd(mean + c);
+        const __m128d d = _mm_sub_pd(xv, ov);
+        const __m128d mv = _mm_add_pd(mo, _mm_mul_pd(d, k));
+        _mm_storeu_pd(mean + c, mv);
+        const __m128d e = _mm_add_pd(_mm_sub_pd(xv, mv), _mm_sub_pd(ov, mo));
+        _mm_storeu_pd(m2 + c, _mm_add_pd(_mm_loadu_pd(m2 + c), _mm_mul_pd(d, e)));
+    }
+    return c;
+}
+#else
+inline int welford_grow_simd(double*, double*, const double*, double, int)
+{
+    return 0;
+}
+
+inline int welford_slide_simd(double*, double*, const double*, const double*, double, int)
+{
+    return 0;
+}
+#endif
+
+/**
+ * @brief Welford update of every channel when the window grows by one value
+ */
+inline void welford_grow(double* mean, double* m2, const double* x, double inv, int n)
+{
+    for (int c = welford_grow_simd(mean, m2, x, inv, n); c < n; c++) {
+        const double d = x[c] - mean[c];
+        mean[c] += d * inv;
+        m2[c] += d * (x[c] - mean[c]);
+    }
+}
+
+/**
+ * @brief Welford update of every channel when xo leaves a full window and x enters it
+ */
+inline void welford_slide(double* mean, double* m2, const double* x, const double* xo,
+    double inv, int n)
+{
+    for (int c = welford_slide_simd(mean, m2, x, xo, inv, n); c < n; c++) {
+        const double mo = mean[c];
+        const double d = x[c] - xo[c];
+        mean[c] += d * inv;
+        m2[c] += d * ((x[c] - mean[c]) + (xo[c] - mo));
+    }
+}
+
+} // namespace ortalama_detail
 
 /**
  * @brief A class for calculating the rolling average of a sequence of values.
  *
  * @details This class provides a templated mechanism to calculate the rolling average of a sequence of values.
+ * The last N values are kept in a ring buffer and the average is updated from a running sum, exact
+ * for integers and Kahan-compensated for floating point types. Nothing is allocated after construction.
+ *
+ * @tparam T Arithmetic type of the values
+ * @tparam W Window size fixed at compile time, or 0 to give it to the constructor
  */
-template <class T>
+template <class T, size_t W = 0>
 class Ortalama {
-    std::queue<T> _list;
-    const size_t _N;
+    static_assert(std::is_arithmetic<T>::value, "Ortalama needs an arithmetic type.");
+
+    ortalama_detail::Window<T, W> _list;
+    ortalama_detail::Sum<T> _sum;
+    size_t _head;
+    size_t _count;
     T _ort;
 
 public:
     Ortalama(size_t N);
+
+    /**
+     * @brief Construct a new Ortalama object with the compile-time window, only when W is not 0
+     */
+    template <size_t V = W, typename std::enable_if<V != 0, int>::type = 0>
+    Ortalama();
+
     const T& ortalama = _ort;
 
     void add(T x);
     void reset();
+
+    /**
+     * @brief Get the number of values in the window
+     */
+    size_t size() const;
+};
+
+/**
+ * @brief Rolling mean, variance, minimum and maximum of C channels sharing one window
+ *
+ * @details Used for values that are smoothed together, e.g. x, y, radius, pitch and roll of a
+ * detection. One add() updates every channel: the samples are kept in one contiguous ring, the
+ * statistics of each kind in one array over the channels, and mean & variance (Welford) are
+ * updated for all channels with SIMD. Minimum and maximum are kept with a monotonic queue per
+ * channel, amortized O(1) per sample. Nothing is allocated after construction.
+ *
+ * @tparam T Arithmetic type of the values
+ * @tparam C Number of channels
+ * @tparam W Window size fixed at compile time, or 0 to give it to the constructor
+ */
+template <class T, size_t C, size_t W = 0>
+class MultiOrtalama {
+    static_assert(std::is_arithmetic<T>::value, "MultiOrtalama needs an arithmetic type.");
+    static_assert(C > 0, "MultiOrtalama needs at least one channel.");
+
+    // sample i of the window is at [slot * C, slot * C + C)
+    ortalama_detail::Window<T, W * C> _samples;
+
+    // per channel ring of the sequence numbers of the candidate minima / maxima
+    ortalama_detail::Window<uint64_t, W * C> _minq;
+    ortalama_detail::Window<uint64_t, W * C> _maxq;
+    std::array<size_t, C> _min_head, _min_size, _max_head, _max_size;
+
+    std::array<double, C> _mean;
+    std::array<double, C> _m2;
+    size_t _window;
+    uint64_t _seq;
+    size_t _count;
+
+    T _value(uint64_t seq, size_t c) const;
+
+    template <class Less>
+    void _push(ortalama_detail::Window<uint64_t, W * C>& q, std::array<size_t, C>& head,
+        std::array<size_t, C>& size, size_t c, T x, Less less);
+
+public:
+    /**
+     * @brief Construct a new MultiOrtalama object
+     *
+     * @param N Window size
+     */
+    MultiOrtalama(size_t N);
+
+    /**
+     * @brief Construct a new MultiOrtalama object with the compile-time window, only when W is not 0
+     */
+    template <size_t V = W, typename std::enable_if<V != 0, int>::type = 0>
+    MultiOrtalama();
+
+    /**
+     * @brief Add one sample of every channel
+     *
+     * @param x C values
+     */
+    void add(const T* x);
+    void add(const std::array<T, C>& x);
+
+    void reset();
+
+    /**
+     * @brief Get the number of samples in the window
+     */
+    size_t size() const;
+
+    const std::array<double, C>& mean() const;
+    double mean(size_t c) const;
+
+    /**
+     * @brief Get the population variance of a channel over the window
+     */
+    double variance(size_t c) const;
+
+    double stddev(size_t c) const;
+
+    T min(size_t c) const;
+    T max(size_t c) const;
+
+    /**
+     * @brief Check whether a sample is within k standard deviations of the mean on every channel
+     *
+     * @details Meant to reject outlier detections before they are added. A window with fewer
+     * than 2 samples accepts everything.
+     *
+     * @param x C values
+     * @param k Accepted distance in standard deviations
+     * @return true if the sample is accepted
+     *         otherwise false
+     */
+    bool within(const T* x, double k) const;
+};
+
+/**
+ * @brief Rolling average of the samples of the last T milliseconds
+ *
+ * @details Unlike Ortalama the window does not stretch when samples arrive less often, e.g. when
+ * the camera FPS drops under load. Samples are kept with their timestamps in a ring of fixed
+ * capacity; the expired ones are evicted from the front, amortized O(1) per sample. If more than
+ * capacity samples arrive within the window, the oldest ones are evicted early.
+ *
+ * @tparam T Arithmetic type of the values
+ */
+template <class T>
+class TimedOrtalama {
+    static_assert(std::is_arithmetic<T>::value, "TimedOrtalama needs an arithmetic type.");
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    ortalama_detail::Window<T, 0> _list;
+    ortalama_detail::Window<Clock::time_point, 0> _stamps;
+    ortalama_detail::Sum<T> _sum;
+    const Clock::duration _span;
+    size_t _head;
+    size_t _count;
+    T _ort;
+
+    void _pop();
+
+public:
+    /**
+     * @brief Construct a new TimedOrtalama object
+     *
+     * @param span Length of the window
+     * @param capacity Maximum number of samples kept
+     */
+    TimedOrtalama(std::chrono::milliseconds span, size_t capacity = 256);
+    const T& ortalama = _ort;
+
+    /**
+     * @brief Add a sample taken at time t
+     *
+     * @param x The sample
+     * @param t Time of the sample, not earlier than the previous one
+     */
+    void add(T x, Clock::time_point t = Clock::now());
+
+    /**
+     * @brief Drop the samples that are older than the window at time t
+     *
+     * @details Call when no sample arrives for a while; the average of an empty window is 0.
+     */
+    void expire(Clock::time_point t = Clock::now());
+
+    void reset();
+
+    /**
+     * @brief Get the number of samples in the window
+     */
+    size_t size() const;
+};
+
+/**
+ * @brief Exponential smoothing whose strength follows the speed of the signal (one euro filter)
+ *
+ * @details A first-order low-pass filter with cutoff = min_cutoff + beta * |speed|, where the speed
+ * is itself low-pass filtered with d_cutoff (Casiez et al., CHI 2012). Slow motion is smoothed
+ * strongly against jitter, fast motion weakly against lag. The smoothing factor is computed from
+ * the real time between samples, so it does not change with the FPS. beta = 0 gives a plain EMA
+ * with time constant 1 / (2 pi min_cutoff).
+ *
+ * @tparam T Floating point type of the values
+ */
+template <class T>
+class OneEuroFilter {
+    static_assert(std::is_floating_point<T>::value, "OneEuroFilter needs a floating point type.");
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    const double _min_cutoff;
+    const double _beta;
+    const double _d_cutoff;
+    bool _started;
+    Clock::time_point _last;
+    T _dx;
+    T _ort;
+
+    static double _alpha(double cutoff, double dt);
+
+public:
+    /**
+     * @brief Construct a new OneEuroFilter object
+     *
+     * @param min_cutoff Cutoff frequency at rest in Hz, lower is smoother
+     * @param beta Increase of the cutoff per unit of speed, higher lags less
+     * @param d_cutoff Cutoff frequency of the speed estimate in Hz
+     */
+    OneEuroFilter(double min_cutoff = 1.0, double beta = 0.0, double d_cutoff = 1.0);
+    const T& ortalama = _ort;
+
+    /**
+     * @brief Add a sample taken at time t
+     *
+     * @param x The sample
+     * @param t Time of the sample; a sample not later than the previous one is ignored
+     */
+    void add(T x, Clock::time_point t = Clock::now());
+
+    void reset();
 };
 
 // template class needs an explicit instantation of the template
@@ -29,30 +450,320 @@ public:
 
 #include <cassert>
 
-template <class T>
-Ortalama<T>::Ortalama(size_t N)
-    : _N(N)
+template <class T, size_t W>
+Ortalama<T, W>::Ortalama(size_t N)
+    : _list(N)
+    , _head(0)
+    , _count(0)
     , _ort(0)
 {
     assert(N > 0);
+    assert(W == 0 || N == W);
+}
+
+template <class T, size_t W>
+template <size_t V, typename std::enable_if<V != 0, int>::type>
+Ortalama<T, W>::Ortalama()
+    : Ortalama(W)
+{
+}
+
+template <class T, size_t W>
+void Ortalama<T, W>::add(T x)
+{
+    T* buf = _list.data();
+    if (_count == _list.size()) {
+        _sum.sub(buf[_head]);
+    } else {
+        _count++;
+    }
+    buf[_head] = x;
+    _sum.add(x);
+    if (++_head == _list.size()) {
+        _head = 0;
+    }
+    _ort = _sum.mean(_count);
+}
+
+template <class T, size_t W>
+void Ortalama<T, W>::reset()
+{
+    _sum.reset();
+    _head = 0;
+    _count = 0;
+    _ort = 0;
+}
+
+template <class T, size_t W>
+size_t Ortalama<T, W>::size() const
+{
+    return _count;
+}
+
+template <class T, size_t C, size_t W>
+MultiOrtalama<T, C, W>::MultiOrtalama(size_t N)
+    : _samples(N * C)
+    , _minq(N * C)
+    , _maxq(N * C)
+    , _window(N)
+{
+    assert(N > 0);
+    assert(W == 0 || N == W);
+    reset();
+}
+
+template <class T, size_t C, size_t W>
+template <size_t V, typename std::enable_if<V != 0, int>::type>
+MultiOrtalama<T, C, W>::MultiOrtalama()
+    : MultiOrtalama(W)
+{
+}
+
+template <class T, size_t C, size_t W>
+void MultiOrtalama<T, C, W>::reset()
+{
+    _min_head.fill(0);
+    _min_size.fill(0);
+    _max_head.fill(0);
+    _max_size.fill(0);
+    _mean.fill(0);
+    _m2.fill(0);
+    _seq = 0;
+    _count = 0;
+}
+
+template <class T, size_t C, size_t W>
+T MultiOrtalama<T, C, W>::_value(uint64_t seq, size_t c) const
+{
+    return _samples.data()[(seq % _window) * C + c];
+}
+
+template <class T, size_t C, size_t W>
+template <class Less>
+void MultiOrtalama<T, C, W>::_push(ortalama_detail::Window<uint64_t, W * C>& q,
+    std::array<size_t, C>& head, std::array<size_t, C>& size, size_t c, T x, Less less)
+{
+    uint64_t* ring = q.data() + c * _window;
+    // the front left the window
+    if (size[c] > 0 && ring[head[c]] + _window <= _seq) {
+        head[c] = head[c] + 1 == _window ? 0 : head[c] + 1;
+        size[c]--;
+    }
+    // candidates that x beats can never be the answer again
+    while (size[c] > 0) {
+        const size_t back = (head[c] + size[c] - 1) % _window;
+        if (less(_value(ring[back], c), x)) {
+            break;
+        }
+        size[c]--;
+    }
+    ring[(head[c] + size[c]) % _window] = _seq;
+    size[c]++;
+}
+
+template <class T, size_t C, size_t W>
+void MultiOrtalama<T, C, W>::add(const T* x)
+{
+    T* slot = _samples.data() + (_seq % _window) * C;
+    std::array<double, C> xn;
+    for (size_t c = 0; c < C; c++) {
+        xn[c] = static_cast<double>(x[c]);
+    }
+    if (_count == _window) {
+        std::array<double, C> xo;
+        for (size_t c = 0; c < C; c++) {
+            xo[c] = static_cast<double>(slot[c]);
+        }
+        ortalama_detail::welford_slide(_mean.data(), _m2.data(), xn.data(), xo.data(),
+            1.0 / _count, static_cast<int>(C));
+    } else {
+        _count++;
+        ortalama_detail::welford_grow(_mean.data(), _m2.data(), xn.data(), 1.0 / _count,
+            static_cast<int>(C));
+    }
+    for (size_t c = 0; c < C; c++) {
+        slot[c] = x[c];
+    }
+    for (size_t c = 0; c < C; c++) {
+        _push(_minq, _min_head, _min_size, c, x[c], [](T a, T b) { return a < b; });
+        _push(_maxq, _max_head, _max_size, c, x[c], [](T a, T b) { return a > b; });
+    }
+    _seq++;
+}
+
+template <class T, size_t C, size_t W>
+void MultiOrtalama<T, C, W>::add(const std::array<T, C>& x)
+{
+    add(x.data());
+}
+
+template <class T, size_t C, size_t W>
+size_t MultiOrtalama<T, C, W>::size() const
+{
+    return _count;
+}
+
+template <class T, size_t C, size_t W>
+const std::array<double, C>& MultiOrtalama<T, C, W>::mean() const
+{
+    return _mean;
+}
+
+template <class T, size_t C, size_t W>
+double MultiOrtalama<T, C, W>::mean(size_t c) const
+{
+    return _mean[c];
+}
+
+template <class T, size_t C, size_t W>
+double MultiOrtalama<T, C, W>::variance(size_t c) const
+{
+    // rounding in the sliding update may leave a tiny negative value for a constant signal
+    return _count == 0 ? 0 : std::max(0.0, _m2[c] / _count);
+}
+
+template <class T, size_t C, size_t W>
+double MultiOrtalama<T, C, W>::stddev(size_t c) const
+{
+    return std::sqrt(variance(c));
+}
+
+template <class T, size_t C, size_t W>
+T MultiOrtalama<T, C, W>::min(size_t c) const
+{
+    assert(_count > 0);
+    return _value(_minq.data()[c * _window + _min_head[c]], c);
+}
+
+template <class T, size_t C, size_t W>
+T MultiOrtalama<T, C, W>::max(size_t c) const
+{
+    assert(_count > 0);
+    return _value(_maxq.data()[c * _window + _max_head[c]], c);
+}
+
+template <class T, size_t C, size_t W>
+bool MultiOrtalama<T, C, W>::within(const T* x, double k) const
+{
+    if (_count < 2) {
+        return true;
+    }
+    for (size_t c = 0; c < C; c++) {
+        const double d = static_cast<double>(x[c]) - _mean[c];
+        if (d * d > k * k * variance(c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class T>
+TimedOrtalama<T>::TimedOrtalama(std::chrono::milliseconds span, size_t capacity)
+    : _list(capacity)
+    , _stamps(capacity)
+    , _span(span)
+    , _head(0)
+    , _count(0)
+    , _ort(0)
+{
+    assert(capacity > 0);
+    assert(span.count() > 0);
+}
+
+template <class T>
+void TimedOrtalama<T>::_pop()
+{
+    _sum.sub(_list.data()[_head]);
+    if (++_head == _list.size()) {
+        _head = 0;
+    }
+    _count--;
+}
+
+template <class T>
+void TimedOrtalama<T>::expire(Clock::time_point t)
+{
+    while (_count > 0 && _stamps.data()[_head] + _span <= t) {
+        _pop();
+    }
+    _ort = _count > 0 ? _sum.mean(_count) : 0;
+}
+
+template <class T>
+void TimedOrtalama<T>::add(T x, Clock::time_point t)
+{
+    while (_count > 0 && (_count == _list.size() || _stamps.data()[_head] + _span <= t)) {
+        _pop();
+    }
+    size_t tail = _head + _count;
+    if (tail >= _list.size()) {
+        tail -= _list.size();
+    }
+    _list.data()[tail] = x;
+    _stamps.data()[tail] = t;
+    _sum.add(x);
+    _count++;
+    _ort = _sum.mean(_count);
+}
+
+template <class T>
+void TimedOrtalama<T>::reset()
+{
+    _sum.reset();
+    _head = 0;
+    _count = 0;
+    _ort = 0;
+}
+
+template <class T>
+size_t TimedOrtalama<T>::size() const
+{
+    return _count;
 }
 
 template <class T>
-void Ortalama<T>::add(T x)
+OneEuroFilter<T>::OneEuroFilter(double min_cutoff, double beta, double d_cutoff)
+    : _min_cutoff(min_cutoff)
+    , _beta(beta)
+    , _d_cutoff(d_cutoff)
 {
-    _ort = (_ort * _list.size() + x) / (_list.size() + 1);
-    _list.push(x);
+    assert(min_cutoff > 0 && beta >= 0 && d_cutoff > 0);
+    reset();
+}
 
-    if (_list.size() > _N) {
-        _ort = (_ort * _list.size() - _list.front()) / (_list.size() - 1);
-        _list.pop();
+template <class T>
+double OneEuroFilter<T>::_alpha(double cutoff, double dt)
+{
+    const double tau = 1.0 / (2 * 3.14159265358979323846 * cutoff);
+    return 1.0 / (1.0 + tau / dt);
+}
+
+template <class T>
+void OneEuroFilter<T>::add(T x, Clock::time_point t)
+{
+    if (!_started) {
+        _started = true;
+        _last = t;
+        _ort = x;
+        return;
+    }
+    const double dt = std::chrono::duration<double>(t - _last).count();
+    if (dt <= 0) {
+        return;
     }
+    _last = t;
+
+    const T dx = static_cast<T>((x - _ort) / dt);
+    _dx += static_cast<T>(_alpha(_d_cutoff, dt)) * (dx - _dx);
+    const double cutoff = _min_cutoff + _beta * std::fabs(static_cast<double>(_dx));
+    _ort += static_cast<T>(_alpha(cutoff, dt)) * (x - _ort);
 }
 
 template <class T>
-void Ortalama<T>::reset()
+void OneEuroFilter<T>::reset()
 {
-    _list = std::queue<T>();
+    _started = false;
+    _dx = 0;
     _ort = 0;
 }
 
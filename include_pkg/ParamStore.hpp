@@ -0,0 +1,420 @@
+#ifndef INCLUDE_PKG_PARAMSTORE_HPP
+#define INCLUDE_PKG_PARAMSTORE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif // __linux__
+
+#include <opencv2/core.hpp>
+
+#include <include_pkg/ColorLut.hpp>
+#include <include_pkg/Profiler.hpp>
+#include <include_pkg/blob.hpp>
+#include <include_pkg/detect.hpp>
+#include <include_pkg/hsv.hpp>
+
+/**
+ * @brief Color detection parameters read once from a file and reloaded when the file changes
+ *
+ * @details The file is parsed once and the derived HSV box (and lookup table) is kept in an
+ * immutable snapshot. A background thread watches the file, with inotify on Linux and by polling
+ * its modification time elsewhere, and publishes a new snapshot when the contents change.
+ * Readers take a snapshot once per frame with get(); a reload never changes a snapshot that is
+ * already taken, so a frame in flight sees one consistent parameter set.
+ *
+ * A file that cannot be parsed (e.g. caught half written) is reported and skipped; the last good
+ * parameters stay in use.
+ */
+class ParamStore {
+public:
+    struct Options {
+        /**
+         * @brief Watch the file and reload it when it changes
+         */
+        bool watch = true;
+
+        /**
+         * @brief How often the modification time is checked (also the fallback when inotify is not available)
+         */
+        std::chrono::milliseconds poll = std::chrono::milliseconds(500);
+
+        /**
+         * @brief Build a lookup table with every snapshot
+         */
+        bool lut = true;
+
+        /**
+         * @brief Layout of the lookup table
+         */
+        ColorLut::Mode lut_mode = ColorLut::Mode::Exact;
+
+        /**
+         * @brief Construct a new Options object
+         */
+        Options() { }
+
+        /**
+         * @brief Check whether the parameters in Options struct is valid
+         *
+         * @return true if all the parameters are valid
+         *         otherwise false
+         */
+        bool check() const;
+    };
+
+    /**
+     * @brief One parsed parameter set with everything derived from it
+     */
+    struct Snapshot {
+        /**
+         * @brief Parameters in the form returned by read_params: (B,G,R), (H), (S), (V)
+         */
+        std::tuple<cv::Scalar, int, int, int> params;
+
+        hsv::Bounds bounds;
+
+        /**
+         * @brief Lookup table for bounds, empty if Options::lut is false
+         */
+        std::unique_ptr<ColorLut> lut;
+
+        /**
+         * @brief Incremented with every published snapshot, starting at 1
+         */
+        uint64_t version;
+    };
+
+private:
+    std::string _path;
+    Options _opt;
+
+    std::shared_ptr<const Snapshot> _current;
+    std::atomic<uint64_t> _reloads;
+
+    // modification time and size of the file when it was last parsed
+    struct Stamp {
+        int64_t mtime_ns = -1;
+        int64_t size = -1;
+        bool operator==(const Stamp& o) const { return mtime_ns == o.mtime_ns && size == o.size; }
+    };
+    Stamp _stamp;
+
+    // serializes reloads from the watcher and from the user
+    std::mutex _reload;
+
+    std::thread _t;
+    std::mutex _m;
+    std::condition_variable _cv;
+    bool _stop;
+#ifdef __linux__
+    int _stop_pipe[2] = { -1, -1 };
+#endif // __linux__
+
+    Stamp _stat() const;
+    std::shared_ptr<const Snapshot> _build(std::tuple<cv::Scalar, int, int, int> params, uint64_t version) const;
+    void _watch();
+
+public:
+    /**
+     * @brief Parse the file and start watching it
+     *
+     * @param path File in the form of red green blue hue_range saturation_range value_range
+     * @param opt Store options
+     * @throw std::runtime_error if the file cannot be read or parsed
+     */
+    explicit ParamStore(std::string path, const Options& opt = Options());
+
+    /**
+     * @brief Stop watching the file
+     */
+    ~ParamStore();
+
+    /**
+     * @brief Parse a parameter file
+     *
+     * @param path File in the form of red green blue hue_range saturation_range value_range
+     * @return std::tuple<cv::Scalar, int, int, int> (B,G,R), (H), (S), (V)
+     * @throw std::runtime_error if the file cannot be read or parsed
+     */
+    static std::tuple<cv::Scalar, int, int, int> parse(const std::string& path);
+
+    /**
+     * @brief Get the current parameters
+     *
+     * @details Take the snapshot once per frame and use it for the whole frame. The snapshot stays
+     * valid as long as it is held, even if newer parameters are published meanwhile.
+     */
+    std::shared_ptr<const Snapshot> get() const;
+
+    /**
+     * @brief Re-read the file now
+     *
+     * @return true if the parameters changed and a new snapshot was published
+     *         otherwise false
+     * @throw std::runtime_error if the file cannot be read or parsed
+     */
+    bool reload();
+
+    /**
+     * @brief Get the number of snapshots published since construction, excluding the first
+     */
+    uint64_t reloads() const;
+
+    /**
+     * @brief Get the watched file
+     */
+    const std::string& path() const;
+
+    ParamStore(const ParamStore&) = delete;
+    ParamStore& operator=(const ParamStore&) = delete;
+};
+
+/**
+ * @brief Finds the biggest group of specified color with the current parameters of a store
+ *
+ * @details The snapshot is taken once, so a reload during the call does not mix parameter sets.
+ * The lookup table of the snapshot is used if it has one.
+ *
+ * @param image The input image
+ * @param hue_image The output mask where the detected color is masked, reused across calls
+ * @param store Parameter store
+ * @return A pair containing the center and radius of the detected group (radius 0 if none)
+ */
+std::pair<cv::Point, int> detect_color(const cv::Mat& image, cv::Mat& hue_image,
+    const ParamStore& store);
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline bool ParamStore::Options::check() const
+{
+    return poll.count() > 0;
+}
+
+inline ParamStore::ParamStore(std::string path, const Options& opt)
+    : _path(std::move(path))
+    , _opt(opt)
+    , _reloads(0)
+    , _stop(false)
+{
+    if (!_opt.check()) {
+        throw std::invalid_argument("Invalid parameter store options.");
+    }
+    _stamp = _stat();
+    std::atomic_store(&_current, _build(parse(_path), 1));
+    if (_opt.watch) {
+#ifdef __linux__
+        if (pipe2(_stop_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+            _stop_pipe[0] = _stop_pipe[1] = -1;
+        }
+#endif // __linux__
+        _t = std::thread(&ParamStore::_watch, this);
+    }
+}
+
+inline ParamStore::~ParamStore()
+{
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        _stop = true;
+    }
+    _cv.notify_all();
+#ifdef __linux__
+    if (_stop_pipe[1] >= 0) {
+        const char byte = 0;
+        (void)!write(_stop_pipe[1], &byte, 1);
+    }
+#endif // __linux__
+    if (_t.joinable()) {
+        _t.join();
+    }
+#ifdef __linux__
+    for (int fd : _stop_pipe) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif // __linux__
+}
+
+inline std::tuple<cv::Scalar, int, int, int> ParamStore::parse(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + path + ".");
+    }
+    int r, g, b, h, s, v;
+    if (!(file >> r >> g >> b >> h >> s >> v)) {
+        throw std::runtime_error("Cannot parse " + path
+            + ", expected red green blue hue_range saturation_range value_range.");
+    }
+    return std::make_tuple(cv::Scalar(b, g, r), h, s, v);
+}
+
+inline ParamStore::Stamp ParamStore::_stat() const
+{
+    Stamp stamp;
+    struct stat st;
+    if (stat(_path.c_str(), &st) != 0) {
+        return stamp;
+    }
+#ifdef __linux__
+    stamp.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    stamp.mtime_ns = static_cast<int64_t>(st.st_mtime) * 1000000000;
+#endif // __linux__
+    stamp.size = static_cast<int64_t>(st.st_size);
+    return stamp;
+}
+
+inline std::shared_ptr<const ParamStore::Snapshot> ParamStore::_build(
+    std::tuple<cv::Scalar, int, int, int> params, uint64_t version) const
+{
+    auto snap = std::make_shared<Snapshot>();
+    snap->params = params;
+    snap->bounds = hsv::make_bounds(std::get<0>(params), std::get<1>(params),
+        std::get<2>(params), std::get<3>(params));
+    if (_opt.lut) {
+        snap->lut.reset(new ColorLut(snap->bounds, _opt.lut_mode));
+    }
+    snap->version = version;
+    return snap;
+}
+
+inline std::shared_ptr<const ParamStore::Snapshot> ParamStore::get() const
+{
+    return std::atomic_load(&_current);
+}
+
+inline bool ParamStore::reload()
+{
+    std::lock_guard<std::mutex> lock(_reload);
+    // stat before reading, so that a write racing with the parse is seen again next time; a file
+    // that fails to parse is not retried until it changes
+    _stamp = _stat();
+    auto params = parse(_path);
+
+    const std::shared_ptr<const Snapshot> current = get();
+    const cv::Scalar& color = std::get<0>(params);
+    const cv::Scalar& old_color = std::get<0>(current->params);
+    if (color[0] == old_color[0] && color[1] == old_color[1] && color[2] == old_color[2]
+        && std::get<1>(params) == std::get<1>(current->params)
+        && std::get<2>(params) == std::get<2>(current->params)
+        && std::get<3>(params) == std::get<3>(current->params)) {
+        return false;
+    }
+    // the table is built before the swap; readers never wait for it
+    std::atomic_store(&_current, _build(params, current->version + 1));
+    _reloads++;
+    return true;
+}
+
+inline uint64_t ParamStore::reloads() const
+{
+    return _reloads;
+}
+
+inline const std::string& ParamStore::path() const
+{
+    return _path;
+}
+
+inline void ParamStore::_watch()
+{
+#ifdef __linux__
+    // editors often replace the file instead of writing it, so the directory is watched
+    int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd >= 0) {
+        const size_t slash = _path.find_last_of('/');
+        const std::string dir = slash == std::string::npos ? "." : _path.substr(0, slash + 1);
+        if (inotify_add_watch(fd, dir.c_str(),
+                IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ATTRIB | IN_MODIFY) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+#endif // __linux__
+
+    while (true) {
+#ifdef __linux__
+        if (fd >= 0 && _stop_pipe[0] >= 0) {
+            pollfd fds[2] = { { fd, POLLIN, 0 }, { _stop_pipe[0], POLLIN, 0 } };
+            poll(fds, 2, static_cast<int>(_opt.poll.count()));
+            if (fds[0].revents & POLLIN) {
+                char events[4096];
+                while (read(fd, events, sizeof(events)) > 0) {
+                }
+            }
+        } else
+#endif // __linux__
+        {
+            std::unique_lock<std::mutex> lock(_m);
+            _cv.wait_for(lock, _opt.poll, [this] { return _stop; });
+        }
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            if (_stop) {
+                break;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_reload);
+            if (_stat() == _stamp) {
+                continue;
+            }
+        }
+        try {
+            reload();
+        } catch (const std::exception& e) {
+            std::cerr << "ParamStore: keeping the last parameters, " << e.what() << std::endl;
+        }
+    }
+
+#ifdef __linux__
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif // __linux__
+}
+
+inline std::pair<cv::Point, int> detect_color(const cv::Mat& image, cv::Mat& hue_image,
+    const ParamStore& store)
+{
+    PROFILE_SCOPE("detect_color");
+    const std::shared_ptr<const ParamStore::Snapshot> snap = store.get();
+    if (snap->lut) {
+        color_mask(image, hue_image, *snap->lut);
+    } else {
+        color_mask(image, hue_image, std::get<0>(snap->params), std::get<1>(snap->params),
+            std::get<2>(snap->params), std::get<3>(snap->params));
+    }
+    Blob blob;
+    {
+        PROFILE_SCOPE("largest_blob");
+        blob = largest_blob(hue_image);
+    }
+    return { blob.center(), blob.radius() };
+}
+
+#endif // INCLUDE_PKG_PARAMSTORE_HPP
@@ -0,0 +1,312 @@
+#ifndef INCLUDE_PKG_PIPELINE_HPP
+#define INCLUDE_PKG_PIPELINE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <include_pkg/SpscRing.hpp>
+
+/**
+ * @brief Runs each processing stage on its own thread, connected by bounded queues
+ *
+ * @details A chain such as capture -> mask -> detect -> control is split so that every stage
+ * works on a different frame at the same time: throughput is set by the slowest stage instead
+ * of the sum of all of them. Items are handed between stages with SpscRing, so the buffers in T
+ * are reused along the chain. With Overflow::DropOldest and capacity 1 in front of a stage, that
+ * stage always gets the freshest item available.
+ *
+ * Example:
+ * @code
+ * struct Work { cv::Mat img; std::pair<cv::Point, int> target; };
+ * Pipeline<Work> p;
+ * p.add_stage("capture", [&](Pipeline<Work>::Item& it) { it.data.img = cam.img(); return true; });
+ * p.add_stage("detect", [&](Pipeline<Work>::Item& it) { it.data.target = detect_color(...); return true; });
+ * p.add_stage("control", [&](Pipeline<Work>::Item& it) { mouse.move(it.data.target); return true; },
+ *     SpscRing<Pipeline<Work>::Item>::Overflow::DropOldest, 1);
+ * p.start();
+ * @endcode
+ */
+template <class T>
+class Pipeline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Item {
+        T data;
+
+        /**
+         * @brief Number given by the first stage, in production order
+         */
+        uint64_t seq = 0;
+
+        /**
+         * @brief Time each stage finished with the item, indexed by stage
+         */
+        std::vector<Clock::time_point> stamps;
+    };
+
+    using Ring = SpscRing<Item>;
+    using Overflow = typename Ring::Overflow;
+
+    /**
+     * @brief A stage; returning false drops the item (for the first stage: nothing was produced)
+     */
+    using StageFn = std::function<bool(Item&)>;
+
+    struct StageStats {
+        std::string name;
+
+        /**
+         * @brief Items passed on by the stage
+         */
+        uint64_t processed;
+
+        /**
+         * @brief Items the stage returned false for
+         */
+        uint64_t filtered;
+
+        /**
+         * @brief Items discarded in front of the stage by Overflow::DropOldest
+         */
+        uint64_t dropped;
+
+        /**
+         * @brief Mean time spent in the stage function
+         */
+        double exec_ms;
+
+        /**
+         * @brief Mean time from the end of the first stage to the end of this stage
+         */
+        double latency_ms;
+    };
+
+private:
+    struct Stage {
+        std::string name;
+        StageFn fn;
+        Overflow policy;
+        size_t capacity;
+        std::unique_ptr<Ring> in;
+        std::thread t;
+        std::atomic<uint64_t> processed { 0 };
+        std::atomic<uint64_t> filtered { 0 };
+        std::atomic<uint64_t> exec_ns { 0 };
+        std::atomic<uint64_t> latency_ns { 0 };
+    };
+
+    std::vector<std::unique_ptr<Stage>> _stages;
+    std::atomic<bool> _running;
+    std::atomic<uint64_t> _seq;
+
+    void _run(size_t index);
+
+public:
+    /**
+     * @brief Construct a new Pipeline object
+     */
+    Pipeline();
+
+    /**
+     * @brief Stop the pipeline
+     */
+    ~Pipeline();
+
+    /**
+     * @brief Append a stage
+     *
+     * @param name Name shown in the statistics
+     * @param fn Stage function; the first stage fills the item, the others process it
+     * @param policy What happens when this stage falls behind the previous one (ignored for the
+     *               first stage)
+     * @param capacity Number of items queued in front of this stage (ignored for the first stage)
+     * @return Pipeline& The pipeline
+     */
+    Pipeline& add_stage(const std::string& name, StageFn fn,
+        Overflow policy = Overflow::DropOldest, size_t capacity = 2);
+
+    /**
+     * @brief Start a thread per stage
+     */
+    void start();
+
+    /**
+     * @brief Stop and join every stage; items still queued are discarded
+     *
+     * @note The first stage is only joined once its function returns.
+     */
+    void stop();
+
+    bool running() const;
+
+    /**
+     * @brief Get the statistics of every stage
+     */
+    std::vector<StageStats> stats() const;
+
+    /**
+     * @brief Print the statistics of every stage
+     */
+    void print_stats(std::ostream& os = std::cout) const;
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+template <class T>
+Pipeline<T>::Pipeline()
+    : _running(false)
+    , _seq(0)
+{
+}
+
+template <class T>
+Pipeline<T>::~Pipeline()
+{
+    stop();
+}
+
+template <class T>
+Pipeline<T>& Pipeline<T>::add_stage(const std::string& name, StageFn fn, Overflow policy,
+    size_t capacity)
+{
+    if (_running.load()) {
+        throw std::logic_error("Cannot add a stage to a running pipeline.");
+    }
+    if (capacity == 0) {
+        throw std::invalid_argument("Pipeline stage capacity must be positive.");
+    }
+    std::unique_ptr<Stage> stage(new Stage());
+    stage->name = name;
+    stage->fn = std::move(fn);
+    stage->policy = policy;
+    stage->capacity = capacity;
+    _stages.push_back(std::move(stage));
+    return *this;
+}
+
+template <class T>
+void Pipeline<T>::start()
+{
+    if (_running.load()) {
+        return;
+    }
+    if (_stages.empty()) {
+        throw std::logic_error("Cannot start an empty pipeline.");
+    }
+    for (size_t i = 1; i < _stages.size(); i++) {
+        _stages[i]->in.reset(new Ring(_stages[i]->capacity, _stages[i]->policy));
+    }
+    _running = true;
+    for (size_t i = 0; i < _stages.size(); i++) {
+        _stages[i]->t = std::thread(&Pipeline::_run, this, i);
+    }
+}
+
+template <class T>
+void Pipeline<T>::stop()
+{
+    _running = false;
+    for (std::unique_ptr<Stage>& stage : _stages) {
+        if (stage->in) {
+            stage->in->close();
+        }
+    }
+    for (std::unique_ptr<Stage>& stage : _stages) {
+        if (stage->t.joinable()) {
+            stage->t.join();
+        }
+    }
+}
+
+template <class T>
+bool Pipeline<T>::running() const
+{
+    return _running.load();
+}
+
+template <class T>
+void Pipeline<T>::_run(size_t index)
+{
+    Stage& stage = *_stages[index];
+    Ring* out = index + 1 < _stages.size() ? _stages[index + 1]->in.get() : nullptr;
+    Item item;
+
+    while (_running.load()) {
+        if (stage.in && !stage.in->pop(item)) {
+            break;
+        }
+        // items come back from the queues with whatever size they were created with
+        item.stamps.resize(_stages.size());
+
+        const Clock::time_point begin = Clock::now();
+        const bool keep = stage.fn(item);
+        const Clock::time_point end = Clock::now();
+        if (!keep) {
+            stage.filtered.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (!stage.in) {
+            item.seq = _seq++;
+        }
+        item.stamps[index] = end;
+
+        stage.processed.fetch_add(1, std::memory_order_relaxed);
+        stage.exec_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    end - begin).count(),
+            std::memory_order_relaxed);
+        stage.latency_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       end - item.stamps[0]).count(),
+            std::memory_order_relaxed);
+
+        if (out && !out->push(item)) {
+            break;
+        }
+    }
+}
+
+template <class T>
+std::vector<typename Pipeline<T>::StageStats> Pipeline<T>::stats() const
+{
+    std::vector<StageStats> out;
+    for (const std::unique_ptr<Stage>& stage : _stages) {
+        const uint64_t n = stage->processed.load(std::memory_order_relaxed);
+        StageStats s;
+        s.name = stage->name;
+        s.processed = n;
+        s.filtered = stage->filtered.load(std::memory_order_relaxed);
+        s.dropped = stage->in ? stage->in->dropped() : 0;
+        s.exec_ms = n ? stage->exec_ns.load(std::memory_order_relaxed) / 1e6 / n : 0;
+        s.latency_ms = n ? stage->latency_ns.load(std::memory_order_relaxed) / 1e6 / n : 0;
+        out.push_back(s);
+    }
+    return out;
+}
+
+template <class T>
+void Pipeline<T>::print_stats(std::ostream& os) const
+{
+    for (const StageStats& s : stats()) {
+        os << s.name << ": " << s.processed << " processed, "
+           << s.filtered << " filtered, "
+           << s.dropped << " dropped, "
+           << s.exec_ms << " ms exec, "
+           << s.latency_ms << " ms latency\n";
+    }
+}
+
+#endif // INCLUDE_PKG_PIPELINE_HPP
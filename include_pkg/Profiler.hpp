@@ -0,0 +1,392 @@
+#ifndef INCLUDE_PKG_PROFILER_HPP
+#define INCLUDE_PKG_PROFILER_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief Low-overhead latency probes for the vision loop
+ *
+ * @details Put PROFILE_SCOPE("stage") at the top of a block to time it. Every thread records into
+ * its own log-linear (HDR-style) histograms, so a probe is two timestamp reads and a few relaxed
+ * stores without locks or shared cache lines. profile::print() reports count, throughput and
+ * p50/p99/p999 per stage from any thread.
+ *
+ * The probes are compiled in only if PROFILING is defined; otherwise the macros expand to nothing.
+ * Buckets have 32 sub-buckets per power of two, so percentiles are within about 3%.
+ */
+namespace profile {
+
+constexpr int max_stages = 64;
+
+struct StageReport {
+    std::string name;
+    uint64_t count;
+
+    /**
+     * @brief Calls per second since the start or the last reset
+     */
+    double throughput;
+
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+};
+
+/**
+ * @brief Get the id of a stage, registering it on the first call with that name
+ */
+int stage(const std::string& name);
+
+/**
+ * @brief Read the timestamp counter (TSC on x86, steady_clock elsewhere)
+ */
+uint64_t now();
+
+/**
+ * @brief Get the length of a tick of now() in nanoseconds
+ */
+double ns_per_tick();
+
+/**
+ * @brief Record a duration for a stage in the calling thread's histogram
+ */
+void record(int id, uint64_t ticks);
+
+/**
+ * @brief Times the enclosing scope and records it for a stage
+ */
+class ScopedTimer {
+    const int _id;
+    const uint64_t _start;
+
+public:
+    explicit ScopedTimer(int id);
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+/**
+ * @brief Merge the histograms of every thread and compute the statistics of every stage
+ */
+std::vector<StageReport> report();
+
+/**
+ * @brief Print the statistics of every stage that recorded something
+ */
+void print(std::ostream& os = std::cout);
+
+/**
+ * @brief Clear every histogram and restart the throughput clock
+ */
+void reset();
+
+namespace detail {
+
+    constexpr int sub_bits = 5;
+    constexpr int sub_count = 1 << sub_bits;
+    constexpr int bucket_count = (64 - sub_bits + 1) * sub_count;
+
+    inline int bucket(uint64_t v)
+    {
+        if (v < static_cast<uint64_t>(sub_count)) {
+            return static_cast<int>(v);
+        }
+        const int shift = 63 - __builtin_clzll(v) - sub_bits;
+        return (shift + 1) * sub_count + static_cast<int>((v >> shift) - sub_count);
+    }
+
+    /**
+     * @brief Middle of the values that fall in a bucket
+     */
+    inline double bucket_value(int i)
+    {
+        if (i < sub_count) {
+            return i;
+        }
+        const int shift = i / sub_count - 1;
+        const uint64_t lo = static_cast<uint64_t>(i % sub_count + sub_count) << shift;
+        return lo + ((uint64_t(1) << shift) - 1) / 2.0;
+    }
+
+    // written by the owning thread only; atomics let report() read while it records
+    struct Histogram {
+        std::array<std::atomic<uint64_t>, bucket_count> buckets;
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+
+        Histogram() { clear(); }
+
+        void clear()
+        {
+            for (std::atomic<uint64_t>& b : buckets) {
+                b.store(0, std::memory_order_relaxed);
+            }
+            count.store(0, std::memory_order_relaxed);
+            sum.store(0, std::memory_order_relaxed);
+            max.store(0, std::memory_order_relaxed);
+        }
+
+        void add(uint64_t v)
+        {
+            std::atomic<uint64_t>& b = buckets[bucket(v)];
+            b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            sum.store(sum.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+            if (v > max.load(std::memory_order_relaxed)) {
+                max.store(v, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    struct ThreadData {
+        // published with release so that report() can read a histogram created meanwhile
+        std::array<std::atomic<Histogram*>, max_stages> hists;
+
+        ThreadData()
+        {
+            for (std::atomic<Histogram*>& h : hists) {
+                h.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        ~ThreadData()
+        {
+            for (std::atomic<Histogram*>& h : hists) {
+                delete h.load();
+            }
+        }
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::string> names;
+
+        // kept after their thread exits so their samples stay in the report
+        std::vector<std::shared_ptr<ThreadData>> threads;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    };
+
+    inline Registry& registry()
+    {
+        static Registry r;
+        return r;
+    }
+
+    inline ThreadData& local()
+    {
+        thread_local ThreadData* data = [] {
+            std::shared_ptr<ThreadData> d(new ThreadData());
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.threads.push_back(d);
+            return d.get();
+        }();
+        return *data;
+    }
+
+} // namespace detail
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline int stage(const std::string& name)
+{
+    detail::Registry& r = detail::registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (size_t i = 0; i < r.names.size(); i++) {
+        if (r.names[i] == name) {
+            return static_cast<int>(i);
+        }
+    }
+    if (r.names.size() == static_cast<size_t>(max_stages)) {
+        return -1;
+    }
+    r.names.push_back(name);
+    return static_cast<int>(r.names.size() - 1);
+}
+
+inline uint64_t now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+inline double ns_per_tick()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    // calibrated once against steady_clock, outside of the probes
+    static const double ns = [] {
+        const auto t0 = std::chrono::steady_clock::now();
+        const uint64_t c0 = now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        const auto t1 = std::chrono::steady_clock::now();
+        const uint64_t c1 = now();
+        return std::chrono::duration<double, std::nano>(t1 - t0).count() / (c1 - c0);
+    }();
+    return ns;
+#else
+    return 1.0;
+#endif
+}
+
+inline void record(int id, uint64_t ticks)
+{
+    if (id < 0) {
+        return;
+    }
+    std::atomic<detail::Histogram*>& slot = detail::local().hists[id];
+    detail::Histogram* h = slot.load(std::memory_order_relaxed);
+    if (!h) {
+        h = new detail::Histogram();
+        slot.store(h, std::memory_order_release);
+    }
+    h->add(ticks);
+}
+
+inline ScopedTimer::ScopedTimer(int id)
+    : _id(id)
+    , _start(now())
+{
+}
+
+inline ScopedTimer::~ScopedTimer()
+{
+    record(_id, now() - _start);
+}
+
+inline std::vector<StageReport> report()
+{
+    detail::Registry& r = detail::registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    const double tick = ns_per_tick();
+    const double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - r.start)
+                               .count();
+
+    std::vector<StageReport> out;
+    std::vector<uint64_t> merged(detail::bucket_count);
+    for (size_t s = 0; s < r.names.size(); s++) {
+        std::fill(merged.begin(), merged.end(), 0);
+        uint64_t count = 0, sum = 0, max = 0;
+        for (const std::shared_ptr<detail::ThreadData>& t : r.threads) {
+            const detail::Histogram* h = t->hists[s].load(std::memory_order_acquire);
+            if (!h) {
+                continue;
+            }
+            for (int i = 0; i < detail::bucket_count; i++) {
+                merged[i] += h->buckets[i].load(std::memory_order_relaxed);
+            }
+            count += h->count.load(std::memory_order_relaxed);
+            sum += h->sum.load(std::memory_order_relaxed);
+            max = std::max(max, h->max.load(std::memory_order_relaxed));
+        }
+
+        // the bucket counts may be a few samples ahead of count while a thread records
+        uint64_t total = 0;
+        for (uint64_t c : merged) {
+            total += c;
+        }
+        auto percentile = [&](double p) {
+            const uint64_t rank = static_cast<uint64_t>(p * (total - 1));
+            uint64_t seen = 0;
+            for (int i = 0; i < detail::bucket_count; i++) {
+                seen += merged[i];
+                if (seen > rank) {
+                    return detail::bucket_value(i) * tick;
+                }
+            }
+            return max * tick;
+        };
+
+        StageReport rep;
+        rep.name = r.names[s];
+        rep.count = count;
+        rep.throughput = elapsed > 0 ? count / elapsed : 0;
+        rep.mean_ns = count ? sum * tick / count : 0;
+        rep.p50_ns = total ? percentile(0.5) : 0;
+        rep.p99_ns = total ? percentile(0.99) : 0;
+        rep.p999_ns = total ? percentile(0.999) : 0;
+        rep.max_ns = max * tick;
+        out.push_back(rep);
+    }
+    return out;
+}
+
+inline void print(std::ostream& os)
+{
+    const std::ios::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(1);
+    for (const StageReport& s : report()) {
+        if (s.count == 0) {
+            continue;
+        }
+        os << s.name << ": " << s.count << " calls, " << s.throughput << " /s, "
+           << "mean " << s.mean_ns / 1e3 << " us, "
+           << "p50 " << s.p50_ns / 1e3 << " us, "
+           << "p99 " << s.p99_ns / 1e3 << " us, "
+           << "p999 " << s.p999_ns / 1e3 << " us, "
+           << "max " << s.max_ns / 1e3 << " us\n";
+    }
+    os.flags(flags);
+}
+
+inline void reset()
+{
+    detail::Registry& r = detail::registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const std::shared_ptr<detail::ThreadData>& t : r.threads) {
+        for (const std::atomic<detail::Histogram*>& h : t->hists) {
+            if (detail::Histogram* hist = h.load(std::memory_order_acquire)) {
+                hist->clear();
+            }
+        }
+    }
+    r.start = std::chrono::steady_clock::now();
+}
+
+} // namespace profile
+
+#define __PROFILE_CAT2(a, b) a##b
+#define __PROFILE_CAT(a, b) __PROFILE_CAT2(a, b)
+
+#ifdef PROFILING
+// time the rest of the enclosing scope as stage `name`
+#define PROFILE_SCOPE(name)                                                                \
+    static const int __PROFILE_CAT(__profile_id_, __LINE__) = ::profile::stage(name); \
+    ::profile::ScopedTimer __PROFILE_CAT(__profile_timer_, __LINE__)(                  \
+        __PROFILE_CAT(__profile_id_, __LINE__))
+#else
+#define PROFILE_SCOPE(name) \
+    do {                    \
+    } while (false)
+#endif
+
+#endif // INCLUDE_PKG_PROFILER_HPP
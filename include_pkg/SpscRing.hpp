@@ -0,0 +1,304 @@
+#ifndef INCLUDE_PKG_SPSCRING_HPP
+#define INCLUDE_PKG_SPSCRING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+/**
+ * @brief Bounded single-producer single-consumer queue that hands items off by swapping
+ *
+ * @details push and pop swap the caller's item with the one in the slot, so the buffers of the
+ * items (for example cv::Mat data) circulate between the two threads and are reused instead of
+ * being allocated per item. The fast path is lock-free; a thread only takes the mutex to sleep
+ * when the queue is empty (pop) or full (push with Overflow::Block).
+ *
+ * @note Items handed to the consumer are given back to the producer later, so neither side may
+ * keep references into an item's buffers after handing it over.
+ */
+template <class T>
+class SpscRing {
+public:
+    enum class Overflow {
+        /**
+         * @brief A push into a full queue discards the oldest item, the producer never waits
+         */
+        DropOldest,
+
+        /**
+         * @brief A push into a full queue waits for the consumer (backpressure)
+         */
+        Block
+    };
+
+private:
+    struct Slot {
+        /**
+         * @brief 2 * pos when the slot is free for item pos, 2 * pos + 1 when it holds item pos
+         */
+        std::atomic<uint64_t> seq;
+        T value;
+    };
+
+    const size_t _n;
+    const Overflow _policy;
+    std::unique_ptr<Slot[]> _slots;
+
+    alignas(64) std::atomic<uint64_t> _head;
+
+    // written by the producer only
+    alignas(64) uint64_t _tail;
+
+    std::atomic<uint64_t> _dropped;
+    std::atomic<bool> _closed;
+
+    std::atomic<int> _waiters;
+    std::mutex _wait_mutex;
+    std::condition_variable _wait_cv;
+
+    void _wake();
+
+    template <typename Pred>
+    bool _sleep(Pred ready, std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Check whether the slot at the head is not a free slot anymore
+     */
+    bool _readable() const;
+
+public:
+    /**
+     * @brief Construct a new SpscRing object
+     *
+     * @param capacity Maximum number of queued items
+     * @param policy What a push into a full queue does
+     */
+    explicit SpscRing(size_t capacity, Overflow policy = Overflow::DropOldest);
+
+    /**
+     * @brief Queue an item (producer only)
+     *
+     * @param item The item to queue, replaced with a recycled one
+     * @return true if the item was queued
+     *         false if the queue is closed
+     */
+    bool push(T& item);
+
+    /**
+     * @brief Take the oldest item, waiting while the queue is empty (consumer only)
+     *
+     * @param item Replaced with the oldest item; its old content is recycled
+     * @param timeout Maximum time to wait
+     * @return true if an item was taken
+     *         false on timeout or if the queue is closed and empty
+     */
+    bool pop(T& item, std::chrono::milliseconds timeout = std::chrono::milliseconds::max());
+
+    /**
+     * @brief Take the oldest item if there is one (consumer only)
+     */
+    bool try_pop(T& item);
+
+    /**
+     * @brief Make every waiting and future push fail and pop fail once the queue is empty
+     */
+    void close();
+
+    bool closed() const;
+
+    /**
+     * @brief Get the approximate number of queued items
+     */
+    size_t size() const;
+
+    size_t capacity() const;
+
+    /**
+     * @brief Get the number of items discarded by Overflow::DropOldest
+     */
+    uint64_t dropped() const;
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+template <class T>
+SpscRing<T>::SpscRing(size_t capacity, Overflow policy)
+    : _n(capacity)
+    , _policy(policy)
+    , _head(0)
+    , _tail(0)
+    , _dropped(0)
+    , _closed(false)
+    , _waiters(0)
+{
+    if (capacity == 0) {
+        throw std::invalid_argument("SpscRing capacity must be positive.");
+    }
+    _slots.reset(new Slot[_n]);
+    for (size_t i = 0; i < _n; i++) {
+        _slots[i].seq.store(2 * i, std::memory_order_relaxed);
+    }
+}
+
+template <class T>
+void SpscRing<T>::_wake()
+{
+    if (_waiters.load() > 0) {
+        // the lock orders the store against a waiter that is about to sleep
+        { std::lock_guard<std::mutex> lock(_wait_mutex); }
+        _wait_cv.notify_all();
+    }
+}
+
+template <class T>
+template <typename Pred>
+bool SpscRing<T>::_sleep(Pred ready, std::chrono::milliseconds timeout)
+{
+    _waiters.fetch_add(1);
+    bool ok;
+    {
+        std::unique_lock<std::mutex> lock(_wait_mutex);
+        if (timeout == std::chrono::milliseconds::max()) {
+            _wait_cv.wait(lock, ready);
+            ok = true;
+        } else {
+            ok = _wait_cv.wait_for(lock, timeout, ready);
+        }
+    }
+    _waiters.fetch_sub(1);
+    return ok;
+}
+
+template <class T>
+bool SpscRing<T>::_readable() const
+{
+    const uint64_t head = _head.load();
+    return _slots[head % _n].seq.load() != 2 * head;
+}
+
+template <class T>
+bool SpscRing<T>::push(T& item)
+{
+    const uint64_t pos = _tail;
+    Slot& slot = _slots[pos % _n];
+    while (slot.seq.load() != 2 * pos) {
+        if (_closed.load()) {
+            return false;
+        }
+        if (_policy == Overflow::Block) {
+            _sleep([&] { return _closed.load() || slot.seq.load() == 2 * pos; },
+                std::chrono::milliseconds::max());
+            continue;
+        }
+        // the slot still holds item pos - n; claim it like the consumer would and discard it
+        uint64_t oldest = pos - _n;
+        if (_head.compare_exchange_strong(oldest, oldest + 1)) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+        // the consumer is taking it right now and frees the slot in a moment
+        std::this_thread::yield();
+    }
+    if (_closed.load()) {
+        return false;
+    }
+    std::swap(slot.value, item);
+    slot.seq.store(2 * pos + 1);
+    _tail = pos + 1;
+    _wake();
+    return true;
+}
+
+template <class T>
+bool SpscRing<T>::try_pop(T& item)
+{
+    while (true) {
+        uint64_t pos = _head.load();
+        Slot& slot = _slots[pos % _n];
+        const uint64_t seq = slot.seq.load();
+        if (seq == 2 * pos) {
+            return false;
+        }
+        // anything else means the producer discarded the item meanwhile
+        if (seq == 2 * pos + 1 && _head.compare_exchange_weak(pos, pos + 1)) {
+            std::swap(slot.value, item);
+            slot.seq.store(2 * (pos + _n));
+            _wake();
+            return true;
+        }
+    }
+}
+
+template <class T>
+bool SpscRing<T>::pop(T& item, std::chrono::milliseconds timeout)
+{
+    const auto deadline = timeout == std::chrono::milliseconds::max()
+        ? std::chrono::steady_clock::time_point::max()
+        : std::chrono::steady_clock::now() + timeout;
+    while (!try_pop(item)) {
+        if (_closed.load()) {
+            return try_pop(item);
+        }
+        auto left = std::chrono::milliseconds::max();
+        if (deadline != std::chrono::steady_clock::time_point::max()) {
+            left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) {
+                return false;
+            }
+        }
+        _sleep([this] { return _closed.load() || _readable(); }, left);
+    }
+    return true;
+}
+
+template <class T>
+void SpscRing<T>::close()
+{
+    _closed.store(true);
+    { std::lock_guard<std::mutex> lock(_wait_mutex); }
+    _wait_cv.notify_all();
+}
+
+template <class T>
+bool SpscRing<T>::closed() const
+{
+    return _closed.load();
+}
+
+template <class T>
+size_t SpscRing<T>::size() const
+{
+    const uint64_t head = _head.load();
+    size_t count = 0;
+    for (size_t i = 0; i < _n; i++) {
+        count += _slots[(head + i) % _n].seq.load() == 2 * (head + i) + 1;
+    }
+    return count;
+}
+
+template <class T>
+size_t SpscRing<T>::capacity() const
+{
+    return _n;
+}
+
+template <class T>
+uint64_t SpscRing<T>::dropped() const
+{
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+#endif // INCLUDE_PKG_SPSCRING_HPP
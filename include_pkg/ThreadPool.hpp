@@ -0,0 +1,210 @@
+#ifndef INCLUDE_PKG_THREADPOOL_HPP
+#define INCLUDE_PKG_THREADPOOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief A fixed set of worker threads that execute parallel loops
+ *
+ * @details The threads are created once and sleep between loops, so a loop per frame costs a
+ * wake-up rather than a thread creation. The calling thread takes part in every loop.
+ *
+ * @note parallel_for must not be called from inside a task of the same pool.
+ */
+class ThreadPool {
+    std::vector<std::thread> _workers;
+
+    // serializes loops submitted from different threads
+    std::mutex _submit;
+
+    std::mutex _m;
+    std::condition_variable _cv_work;
+    std::condition_variable _cv_done;
+
+    void (*_task)(void*, size_t);
+    void* _ctx;
+    size_t _n;
+    std::atomic<size_t> _next;
+    size_t _busy;
+    uint64_t _generation;
+    bool _stop;
+    std::exception_ptr _error;
+
+    void _worker();
+
+    /**
+     * @brief Run tasks of the current loop until none is left
+     */
+    void _drain();
+
+public:
+    /**
+     * @brief Construct a new ThreadPool object
+     *
+     * @param threads Total number of threads including the caller (0 for one per core)
+     */
+    explicit ThreadPool(size_t threads = 0);
+
+    /**
+     * @brief Stop and join the worker threads
+     */
+    ~ThreadPool();
+
+    /**
+     * @brief Get the shared pool with one thread per core
+     *
+     * @return ThreadPool& The pool
+     */
+    static ThreadPool& global();
+
+    /**
+     * @brief Get the number of threads a loop runs on, including the caller
+     */
+    size_t size() const;
+
+    /**
+     * @brief Call f(i) for every i in [0, n) on the pool and wait until all calls return
+     *
+     * @details If a call throws, the remaining calls still run and the first exception is
+     * rethrown in the caller.
+     *
+     * @param n Number of tasks
+     * @param f Callable taking the task index
+     */
+    template <typename F>
+    void parallel_for(size_t n, F&& f);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline ThreadPool::ThreadPool(size_t threads)
+    : _task(nullptr)
+    , _ctx(nullptr)
+    , _n(0)
+    , _next(0)
+    , _busy(0)
+    , _generation(0)
+    , _stop(false)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 1; i < threads; i++) {
+        _workers.emplace_back(&ThreadPool::_worker, this);
+    }
+}
+
+inline ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        _stop = true;
+    }
+    _cv_work.notify_all();
+    for (std::thread& t : _workers) {
+        t.join();
+    }
+}
+
+inline ThreadPool& ThreadPool::global()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+inline size_t ThreadPool::size() const
+{
+    return _workers.size() + 1;
+}
+
+inline void ThreadPool::_drain()
+{
+    size_t i;
+    while ((i = _next.fetch_add(1)) < _n) {
+        try {
+            _task(_ctx, i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(_m);
+            if (!_error) {
+                _error = std::current_exception();
+            }
+        }
+    }
+}
+
+inline void ThreadPool::_worker()
+{
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_m);
+            _cv_work.wait(lock, [&] { return _stop || _generation != seen; });
+            if (_stop) {
+                return;
+            }
+            seen = _generation;
+        }
+        _drain();
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            if (--_busy == 0) {
+                _cv_done.notify_one();
+            }
+        }
+    }
+}
+
+template <typename F>
+void ThreadPool::parallel_for(size_t n, F&& f)
+{
+    if (n == 0) {
+        return;
+    }
+    if (n == 1 || _workers.empty()) {
+        for (size_t i = 0; i < n; i++) {
+            f(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit(_submit);
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        _task = [](void* ctx, size_t i) { (*static_cast<std::remove_reference_t<F>*>(ctx))(i); };
+        _ctx = const_cast<void*>(static_cast<const void*>(&f));
+        _n = n;
+        _next = 0;
+        _busy = _workers.size();
+        _error = nullptr;
+        ++_generation;
+    }
+    _cv_work.notify_all();
+    _drain();
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(_m);
+        _cv_done.wait(lock, [&] { return _busy == 0; });
+        error = _error;
+        _error = nullptr;
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+#endif // INCLUDE_PKG_THREADPOOL_HPP
@@ -0,0 +1,205 @@
+#ifndef INCLUDE_PKG_TILEDDETECTOR_HPP
+#define INCLUDE_PKG_TILEDDETECTOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <include_pkg/ThreadPool.hpp>
+#include <include_pkg/blob.hpp>
+#include <include_pkg/hsv.hpp>
+
+/**
+ * @brief Color detection split into horizontal bands processed in parallel
+ *
+ * @details Every band is thresholded and labeled by its own BlobLabeler on a ThreadPool, then
+ * groups that touch across the seams between bands are joined with union-find on the runs of
+ * the rows next to each seam. The result is the same as labeling the whole frame at once.
+ * All buffers, including the pool, are reused across frames.
+ */
+class TiledColorDetector {
+    ThreadPool& _pool;
+    size_t _bands;
+    std::vector<BlobLabeler> _labelers;
+    std::vector<const std::vector<Blob>*> _results;
+    std::vector<int> _offsets;
+    std::vector<int> _parent;
+    std::vector<Blob> _merged;
+    std::vector<Blob> _blobs;
+    cv::Mat _mask;
+
+    int _find(int g);
+
+    /**
+     * @brief Threshold (if image is given) and label every band, then join them
+     */
+    const std::vector<Blob>& _run(const cv::Mat* image, const hsv::Bounds* bounds,
+        const cv::Mat& mask);
+
+public:
+    /**
+     * @brief Construct a new TiledColorDetector object
+     *
+     * @param pool Pool the bands are processed on
+     * @param bands Number of bands (0 for one per pool thread)
+     */
+    explicit TiledColorDetector(ThreadPool& pool = ThreadPool::global(), size_t bands = 0);
+
+    /**
+     * @brief Find every 8-connected group of non-zero pixels of a mask in parallel
+     *
+     * @param mask 8-bit single channel mask
+     * @return const std::vector<Blob>& The groups, valid until the next call
+     */
+    const std::vector<Blob>& label(const cv::Mat& mask);
+
+    /**
+     * @brief Threshold a BGR image and find every group of the accepted color in parallel
+     *
+     * @param image The input BGR image
+     * @param bounds Accepted HSV box
+     * @return const std::vector<Blob>& The groups, valid until the next call
+     */
+    const std::vector<Blob>& detect(const cv::Mat& image, const hsv::Bounds& bounds);
+
+    /**
+     * @brief Finds the biggest group of specified color, same as detect_color
+     *
+     * @param image The input image
+     * @param params Color detection parameters as returned by read_params
+     * @return A pair containing the center and radius of the detected group (radius 0 if none)
+     */
+    std::pair<cv::Point, int> detect_color(const cv::Mat& image,
+        const std::tuple<cv::Scalar, int, int, int>& params);
+
+    /**
+     * @brief Get the mask computed by the last call to detect or detect_color
+     */
+    const cv::Mat& mask() const;
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline TiledColorDetector::TiledColorDetector(ThreadPool& pool, size_t bands)
+    : _pool(pool)
+    , _bands(bands == 0 ? pool.size() : bands)
+    , _labelers(_bands)
+    , _results(_bands)
+{
+}
+
+inline int TiledColorDetector::_find(int g)
+{
+    while (_parent[g] != g) {
+        _parent[g] = _parent[_parent[g]];
+        g = _parent[g];
+    }
+    return g;
+}
+
+inline const std::vector<Blob>& TiledColorDetector::_run(const cv::Mat* image,
+    const hsv::Bounds* bounds, const cv::Mat& mask)
+{
+    const int rows = image ? image->rows : mask.rows;
+    const size_t bands = std::max<size_t>(1, std::min<size_t>(_bands, rows));
+    auto band_begin = [rows, bands](size_t b) { return static_cast<int>(rows * b / bands); };
+
+    _pool.parallel_for(bands, [&](size_t b) {
+        const int y0 = band_begin(b), y1 = band_begin(b + 1);
+        cv::Mat band = mask.rowRange(y0, y1);
+        if (image) {
+            hsv::threshold(image->rowRange(y0, y1), band, *bounds);
+        }
+        _results[b] = &_labelers[b].label(band, y0);
+    });
+
+    _offsets.resize(bands + 1);
+    _offsets[0] = 0;
+    for (size_t b = 0; b < bands; b++) {
+        _offsets[b + 1] = _offsets[b] + static_cast<int>(_results[b]->size());
+    }
+    const int total = _offsets[bands];
+    _parent.resize(total);
+    for (int g = 0; g < total; g++) {
+        _parent[g] = g;
+    }
+
+    // join groups whose runs touch across a seam (8-connected)
+    for (size_t b = 0; b + 1 < bands; b++) {
+        const std::vector<BlobLabeler::Run>& above = _labelers[b].last_row();
+        const std::vector<BlobLabeler::Run>& below = _labelers[b + 1].first_row();
+        size_t p = 0;
+        for (const BlobLabeler::Run& run : below) {
+            while (p < above.size() && above[p].x1 < run.x0) {
+                p++;
+            }
+            for (size_t q = p; q < above.size() && above[q].x0 <= run.x1; q++) {
+                const int a = _find(_offsets[b] + above[q].label);
+                const int c = _find(_offsets[b + 1] + run.label);
+                if (a != c) {
+                    _parent[std::max(a, c)] = std::min(a, c);
+                }
+            }
+        }
+    }
+
+    _merged.assign(total, Blob());
+    for (size_t b = 0; b < bands; b++) {
+        for (size_t i = 0; i < _results[b]->size(); i++) {
+            _merged[_find(_offsets[b] + static_cast<int>(i))].merge((*_results[b])[i]);
+        }
+    }
+    _blobs.clear();
+    for (int g = 0; g < total; g++) {
+        if (_parent[g] == g) {
+            _blobs.push_back(_merged[g]);
+        }
+    }
+    return _blobs;
+}
+
+inline const std::vector<Blob>& TiledColorDetector::label(const cv::Mat& mask)
+{
+    if (mask.type() != CV_8UC1) {
+        throw std::invalid_argument("TiledColorDetector expects an 8-bit single channel mask.");
+    }
+    return _run(nullptr, nullptr, mask);
+}
+
+inline const std::vector<Blob>& TiledColorDetector::detect(const cv::Mat& image,
+    const hsv::Bounds& bounds)
+{
+    if (image.type() != CV_8UC3) {
+        throw std::invalid_argument("TiledColorDetector expects an 8-bit BGR image.");
+    }
+    _mask.create(image.rows, image.cols, CV_8UC1);
+    return _run(&image, &bounds, _mask);
+}
+
+inline std::pair<cv::Point, int> TiledColorDetector::detect_color(const cv::Mat& image,
+    const std::tuple<cv::Scalar, int, int, int>& params)
+{
+    const hsv::Bounds bounds = hsv::make_bounds(std::get<0>(params), std::get<1>(params),
+        std::get<2>(params), std::get<3>(params));
+    Blob best;
+    for (const Blob& b : detect(image, bounds)) {
+        if (b.cnt > best.cnt) {
+            best = b;
+        }
+    }
+    return { best.center(), best.radius() };
+}
+
+inline const cv::Mat& TiledColorDetector::mask() const
+{
+    return _mask;
+}
+
+#endif // INCLUDE_PKG_TILEDDETECTOR_HPP
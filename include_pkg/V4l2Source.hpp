@@ -0,0 +1,604 @@
+#ifndef INCLUDE_PKG_V4L2SOURCE_HPP
+#define INCLUDE_PKG_V4L2SOURCE_HPP
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <include_pkg/FrameSource.hpp>
+
+/**
+ * @brief Captures from a V4L2 device with memory-mapped streaming I/O, without copying frames
+ *
+ * @details The driver buffers are mapped once, and read() returns a cv::Mat header that points
+ * straight into the buffer the driver has just filled. The buffer goes back to the driver queue
+ * when the last cv::Mat referring to it is released, whichever thread that happens on. Frames
+ * come in the device format (YUYV, UYVY and GREY as 2- or 1-channel images, NV12 as a
+ * rows * 3 / 2 x cols plane, BGR24 as CV_8UC3, MJPEG as a single row of compressed bytes); use
+ * to_bgr to convert one for the detectors.
+ *
+ * Every frame held by a reader keeps a driver buffer out of the queue, so Options::buffers must
+ * exceed the number of frames held at once (with a Camera: its slots plus one per reader).
+ * Frames may outlive the source; the buffers are unmapped when the last one is released.
+ *
+ * Behind a Camera, the frames keep the device format and Camera::Frame::fourcc tells which one
+ * it is, so detection code converts them itself:
+ *
+ *   CameraManager::instance().open(std::unique_ptr<FrameSource>(new V4l2Source("/dev/video0")));
+ *   Camera::Frame frame = Camera::getInstance()->wait_next(last_seq);
+ *   cv::Mat bgr, mask;
+ *   if (V4l2Source::to_bgr(frame.img, frame.fourcc, bgr)) {
+ *       detect_color(bgr, mask, params);
+ *   }
+ *
+ * The conversion is the one copy left; it reads the driver buffer directly and writes into bgr,
+ * which is reused across frames.
+ */
+class V4l2Source : public FrameSource {
+public:
+    struct Options {
+        /**
+         * @brief Requested frame width (0 to keep the device setting)
+         */
+        int width = 0;
+
+        /**
+         * @brief Requested frame height (0 to keep the device setting)
+         */
+        int height = 0;
+
+        /**
+         * @brief Requested pixel format, e.g. V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12 or V4L2_PIX_FMT_MJPEG
+         */
+        uint32_t fourcc = V4L2_PIX_FMT_YUYV;
+
+        /**
+         * @brief Requested frame rate (0 to keep the device setting)
+         */
+        double fps = 0;
+
+        /**
+         * @brief Number of driver buffers (at least 2)
+         */
+        unsigned buffers = 6;
+
+        /**
+         * @brief Export every buffer as a DMABUF file descriptor, see dmabuf()
+         */
+        bool export_dmabuf = false;
+
+        /**
+         * @brief How long read() waits for a frame before failing, in milliseconds
+         */
+        int timeout_ms = 1000;
+
+        /**
+         * @brief Construct a new Options object
+         */
+        Options() { }
+
+        /**
+         * @brief Check whether the parameters in Options struct is valid
+         *
+         * @return true if all the parameters are valid
+         *         otherwise false
+         */
+        bool check() const;
+    };
+
+private:
+    /**
+     * @brief The open device and its mapped buffers
+     *
+     * @details Also the allocator of the frames handed out: deallocate() queues the buffer again.
+     * It is shared between the source and the frames, and deletes itself once the source is
+     * released and no frame is left.
+     */
+    class Device : public cv::MatAllocator {
+    public:
+        struct Buffer {
+            void* start = MAP_FAILED;
+            size_t length = 0;
+            int dmabuf = -1;
+        };
+
+        int fd = -1;
+        std::vector<Buffer> buffers;
+
+        mutable std::mutex m;
+        mutable size_t outstanding = 0;
+        mutable bool closed = false;
+
+        /**
+         * @brief Give a buffer back to the driver
+         */
+        bool queue(unsigned index) const;
+
+        /**
+         * @brief Stop streaming and free the device once no frame is left
+         */
+        void close();
+
+        cv::UMatData* allocate(int, const int*, int, void*, size_t*, cv::AccessFlag,
+            cv::UMatUsageFlags) const override;
+        bool allocate(cv::UMatData*, cv::AccessFlag, cv::UMatUsageFlags) const override;
+        void deallocate(cv::UMatData* u) const override;
+
+    private:
+        /**
+         * @brief Unmap the buffers and close the device
+         */
+        void _free() const;
+    };
+
+    Device* _dev;
+    Options _opt;
+    uint32_t _fourcc;
+    int _width;
+    int _height;
+    int _stride;
+    uint32_t _last_sequence;
+    bool _started;
+    std::atomic<uint64_t> _dropped;
+
+    static int _ioctl(int fd, unsigned long request, void* arg);
+
+    /**
+     * @brief Wrap a filled buffer into a cv::Mat header in the device format
+     */
+    cv::Mat _wrap(unsigned index, size_t bytesused);
+
+public:
+    /**
+     * @brief Open a device and start streaming
+     *
+     * @param path Device node, e.g. "/dev/video0"
+     * @param opt Capture options
+     * @throw std::runtime_error if the device cannot stream with memory-mapped buffers
+     */
+    explicit V4l2Source(const std::string& path, const Options& opt = Options());
+
+    ~V4l2Source() override;
+
+    /**
+     * @brief Get the pixel format the driver chose
+     */
+    uint32_t fourcc() const override;
+
+    /**
+     * @brief Get the frame size the driver chose
+     */
+    cv::Size size() const;
+
+    /**
+     * @brief Get the number of frames the driver dropped, from gaps in its sequence numbers
+     */
+    uint64_t dropped() const;
+
+    /**
+     * @brief Get the DMABUF file descriptor of the buffer behind a frame
+     *
+     * @param frame A frame returned by read()
+     * @return int The descriptor, owned by the source, or -1 if not exported
+     */
+    int dmabuf(const cv::Mat& frame) const;
+
+    /**
+     * @brief Convert a frame to BGR
+     *
+     * @details Works on frames of any source, e.g. a Camera::Frame with its fourcc; a fourcc of 0
+     * means the frame is BGR already and it is copied.
+     *
+     * @param raw A frame in the given format
+     * @param fourcc Its pixel format: 0, V4L2_PIX_FMT_YUYV, _UYVY, _NV12, _GREY, _BGR24, _MJPEG or _JPEG
+     * @param bgr The output image, reallocated only if its size changes
+     * @return true if the format is supported and the frame could be decoded
+     *         otherwise false
+     */
+    static bool to_bgr(const cv::Mat& raw, uint32_t fourcc, cv::Mat& bgr);
+
+    /**
+     * @brief Convert a frame read from this source to BGR
+     */
+    bool to_bgr(const cv::Mat& raw, cv::Mat& bgr) const;
+
+    bool isOpened() const override;
+
+    /**
+     * @brief Wait for the next frame and hand out the driver buffer it was captured into
+     *
+     * @details Whatever img referred to is released first, so that its buffer can be refilled.
+     */
+    bool read(cv::Mat& img) override;
+
+    void release() override;
+
+    V4l2Source(const V4l2Source&) = delete;
+    V4l2Source& operator=(const V4l2Source&) = delete;
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline bool V4l2Source::Options::check() const
+{
+    return width >= 0 && height >= 0 && fps >= 0 && buffers >= 2 && timeout_ms >= 0;
+}
+
+inline bool V4l2Source::Device::queue(unsigned index) const
+{
+    v4l2_buffer buf;
+    std::memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    return V4l2Source::_ioctl(fd, VIDIOC_QBUF, &buf) == 0;
+}
+
+inline void V4l2Source::Device::_free() const
+{
+    for (const Buffer& b : buffers) {
+        if (b.dmabuf >= 0) {
+            ::close(b.dmabuf);
+        }
+        if (b.start != MAP_FAILED) {
+            ::munmap(b.start, b.length);
+        }
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+inline void V4l2Source::Device::close()
+{
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(m);
+        closed = true;
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        V4l2Source::_ioctl(fd, VIDIOC_STREAMOFF, &type);
+        last = outstanding == 0;
+    }
+    if (last) {
+        _free();
+        delete this;
+    }
+}
+
+inline cv::UMatData* V4l2Source::Device::allocate(int, const int*, int, void*, size_t*,
+    cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    // frames are never reallocated through this allocator; copies use the default one
+    return nullptr;
+}
+
+inline bool V4l2Source::Device::allocate(cv::UMatData*, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    return false;
+}
+
+inline void V4l2Source::Device::deallocate(cv::UMatData* u) const
+{
+    const unsigned index = static_cast<unsigned>(reinterpret_cast<uintptr_t>(u->handle));
+    delete u;
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if (!closed) {
+            queue(index);
+        }
+        last = --outstanding == 0 && closed;
+    }
+    if (last) {
+        _free();
+        delete this;
+    }
+}
+
+inline int V4l2Source::_ioctl(int fd, unsigned long request, void* arg)
+{
+    int r;
+    do {
+        r = ::ioctl(fd, request, arg);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+inline V4l2Source::V4l2Source(const std::string& path, const Options& opt)
+    : _dev(new Device())
+    , _opt(opt)
+    , _fourcc(0)
+    , _width(0)
+    , _height(0)
+    , _stride(0)
+    , _last_sequence(0)
+    , _started(false)
+    , _dropped(0)
+{
+    if (!_opt.check()) {
+        delete _dev;
+        throw std::invalid_argument("Invalid V4L2 options.");
+    }
+    auto fail = [this, &path](const char* what) {
+        const std::string msg = path + ": " + what + " (" + std::strerror(errno) + ").";
+        release();
+        throw std::runtime_error(msg);
+    };
+
+    _dev->fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (_dev->fd < 0) {
+        fail("cannot open the device");
+    }
+
+    v4l2_capability cap;
+    std::memset(&cap, 0, sizeof(cap));
+    if (_ioctl(_dev->fd, VIDIOC_QUERYCAP, &cap) != 0) {
+        fail("not a V4L2 device");
+    }
+    const uint32_t caps = cap.capabilities & V4L2_CAP_DEVICE_CAPS ? cap.device_caps : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING)) {
+        errno = ENOTSUP;
+        fail("no single-planar streaming capture");
+    }
+
+    v4l2_format fmt;
+    std::memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (_ioctl(_dev->fd, VIDIOC_G_FMT, &fmt) != 0) {
+        fail("cannot get the format");
+    }
+    if (_opt.width > 0 && _opt.height > 0) {
+        fmt.fmt.pix.width = static_cast<uint32_t>(_opt.width);
+        fmt.fmt.pix.height = static_cast<uint32_t>(_opt.height);
+    }
+    fmt.fmt.pix.pixelformat = _opt.fourcc;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (_ioctl(_dev->fd, VIDIOC_S_FMT, &fmt) != 0) {
+        fail("cannot set the format");
+    }
+    // the driver may adjust everything; take what it chose
+    _fourcc = fmt.fmt.pix.pixelformat;
+    _width = static_cast<int>(fmt.fmt.pix.width);
+    _height = static_cast<int>(fmt.fmt.pix.height);
+    _stride = static_cast<int>(fmt.fmt.pix.bytesperline);
+
+    if (_opt.fps > 0) {
+        v4l2_streamparm parm;
+        std::memset(&parm, 0, sizeof(parm));
+        parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        parm.parm.capture.timeperframe.numerator = 1000;
+        parm.parm.capture.timeperframe.denominator = static_cast<uint32_t>(_opt.fps * 1000);
+        // best effort, many devices only have fixed rates
+        _ioctl(_dev->fd, VIDIOC_S_PARM, &parm);
+    }
+
+    v4l2_requestbuffers req;
+    std::memset(&req, 0, sizeof(req));
+    req.count = _opt.buffers;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (_ioctl(_dev->fd, VIDIOC_REQBUFS, &req) != 0 || req.count < 2) {
+        fail("cannot get memory-mapped buffers");
+    }
+    _dev->buffers.resize(req.count);
+    for (unsigned i = 0; i < req.count; i++) {
+        v4l2_buffer buf;
+        std::memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (_ioctl(_dev->fd, VIDIOC_QUERYBUF, &buf) != 0) {
+            fail("cannot query a buffer");
+        }
+        Device::Buffer& b = _dev->buffers[i];
+        b.length = buf.length;
+        b.start = ::mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, _dev->fd, buf.m.offset);
+        if (b.start == MAP_FAILED) {
+            fail("cannot map a buffer");
+        }
+        if (_opt.export_dmabuf) {
+            v4l2_exportbuffer exp;
+            std::memset(&exp, 0, sizeof(exp));
+            exp.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            exp.index = i;
+            exp.flags = O_RDONLY | O_CLOEXEC;
+            if (_ioctl(_dev->fd, VIDIOC_EXPBUF, &exp) != 0) {
+                fail("cannot export a buffer as DMABUF");
+            }
+            b.dmabuf = exp.fd;
+        }
+        if (!_dev->queue(i)) {
+            fail("cannot queue a buffer");
+        }
+    }
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (_ioctl(_dev->fd, VIDIOC_STREAMON, &type) != 0) {
+        fail("cannot start streaming");
+    }
+}
+
+inline V4l2Source::~V4l2Source()
+{
+    release();
+}
+
+inline uint32_t V4l2Source::fourcc() const
+{
+    return _fourcc;
+}
+
+inline cv::Size V4l2Source::size() const
+{
+    return cv::Size(_width, _height);
+}
+
+inline uint64_t V4l2Source::dropped() const
+{
+    return _dropped;
+}
+
+inline int V4l2Source::dmabuf(const cv::Mat& frame) const
+{
+    if (!_dev || !frame.u || frame.u->currAllocator != _dev) {
+        return -1;
+    }
+    return _dev->buffers[reinterpret_cast<uintptr_t>(frame.u->handle)].dmabuf;
+}
+
+inline bool V4l2Source::isOpened() const
+{
+    return _dev != nullptr;
+}
+
+inline cv::Mat V4l2Source::_wrap(unsigned index, size_t bytesused)
+{
+    uchar* data = static_cast<uchar*>(_dev->buffers[index].start);
+    const size_t step = static_cast<size_t>(_stride);
+    cv::Mat img;
+    switch (_fourcc) {
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_UYVY:
+        img = cv::Mat(_height, _width, CV_8UC2, data, step);
+        break;
+    case V4L2_PIX_FMT_NV12:
+        img = cv::Mat(_height * 3 / 2, _width, CV_8UC1, data, step);
+        break;
+    case V4L2_PIX_FMT_GREY:
+        img = cv::Mat(_height, _width, CV_8UC1, data, step);
+        break;
+    case V4L2_PIX_FMT_BGR24:
+        img = cv::Mat(_height, _width, CV_8UC3, data, step);
+        break;
+    default:
+        // compressed formats: the bytes the driver wrote
+        img = cv::Mat(1, static_cast<int>(bytesused), CV_8UC1, data);
+        break;
+    }
+
+    // attach a reference count whose release queues the buffer again
+    cv::UMatData* u = new cv::UMatData(_dev);
+    u->data = u->origdata = data;
+    u->size = _dev->buffers[index].length;
+    u->refcount = 1;
+    u->handle = reinterpret_cast<void*>(static_cast<uintptr_t>(index));
+    u->flags |= cv::UMatData::USER_ALLOCATED;
+    img.u = u;
+    return img;
+}
+
+inline bool V4l2Source::read(cv::Mat& img)
+{
+    // the allocator of a Camera slot is kept for whatever the slot is used for later
+    cv::MatAllocator* allocator = img.allocator;
+    img.release();
+    if (!_dev) {
+        return false;
+    }
+
+    v4l2_buffer buf;
+    while (true) {
+        std::memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (_ioctl(_dev->fd, VIDIOC_DQBUF, &buf) == 0) {
+            break;
+        }
+        if (errno != EAGAIN) {
+            return false;
+        }
+        pollfd pfd = { _dev->fd, POLLIN, 0 };
+        if (::poll(&pfd, 1, _opt.timeout_ms) <= 0) {
+            return false;
+        }
+    }
+
+    if (buf.flags & V4L2_BUF_FLAG_ERROR) {
+        _dev->queue(buf.index);
+        return false;
+    }
+    if (_started && buf.sequence > _last_sequence + 1) {
+        _dropped.fetch_add(buf.sequence - _last_sequence - 1, std::memory_order_relaxed);
+    }
+    _last_sequence = buf.sequence;
+    _started = true;
+
+    {
+        std::lock_guard<std::mutex> lock(_dev->m);
+        _dev->outstanding++;
+    }
+    img = _wrap(buf.index, buf.bytesused);
+    img.allocator = allocator;
+    return true;
+}
+
+inline bool V4l2Source::to_bgr(const cv::Mat& raw, cv::Mat& bgr) const
+{
+    return to_bgr(raw, _fourcc, bgr);
+}
+
+inline bool V4l2Source::to_bgr(const cv::Mat& raw, uint32_t fourcc, cv::Mat& bgr)
+{
+    if (raw.empty()) {
+        return false;
+    }
+    switch (fourcc) {
+    case 0:
+        raw.copyTo(bgr);
+        return true;
+    case V4L2_PIX_FMT_YUYV:
+        cv::cvtColor(raw, bgr, cv::COLOR_YUV2BGR_YUYV);
+        return true;
+    case V4L2_PIX_FMT_UYVY:
+        cv::cvtColor(raw, bgr, cv::COLOR_YUV2BGR_UYVY);
+        return true;
+    case V4L2_PIX_FMT_NV12:
+        cv::cvtColor(raw, bgr, cv::COLOR_YUV2BGR_NV12);
+        return true;
+    case V4L2_PIX_FMT_GREY:
+        cv::cvtColor(raw, bgr, cv::COLOR_GRAY2BGR);
+        return true;
+    case V4L2_PIX_FMT_BGR24:
+        raw.copyTo(bgr);
+        return true;
+    case V4L2_PIX_FMT_MJPEG:
+    case V4L2_PIX_FMT_JPEG:
+        bgr = cv::imdecode(raw, cv::IMREAD_COLOR);
+        return !bgr.empty();
+    default:
+        return false;
+    }
+}
+
+inline void V4l2Source::release()
+{
+    if (_dev) {
+        _dev->close();
+        _dev = nullptr;
+    }
+}
+
+#endif // __linux__
+
+#endif // INCLUDE_PKG_V4L2SOURCE_HPP
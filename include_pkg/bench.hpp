@@ -0,0 +1,360 @@
+#ifndef INCLUDE_PKG_BENCH_HPP
+#define INCLUDE_PKG_BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <opencv2/core.hpp>
+
+#include <include_pkg/FrameSource.hpp>
+
+/**
+ * @brief Micro-benchmark harness, the performance counterpart of test.hpp
+ *
+ * @details Every benchmark is warmed up, then timed in batches long enough for the clock to be
+ * accurate; the per-call times of the batches are summarized. Results are printed and written
+ * to a tab-separated file so that runs can be compared over time.
+ */
+namespace bench {
+
+struct Options {
+    /**
+     * @brief Untimed calls before measuring
+     */
+    int warmup = 3;
+
+    /**
+     * @brief Number of timed batches
+     */
+    int repeats = 30;
+
+    /**
+     * @brief Minimum duration of a batch; fast functions are called several times per batch
+     */
+    std::chrono::microseconds min_batch { 200 };
+
+    /**
+     * @brief Core to pin the benchmarking thread to (-1 for no pinning)
+     */
+    int cpu = -1;
+
+    /**
+     * @brief Only benchmarks whose name contains this string are run
+     */
+    std::string filter;
+
+    /**
+     * @brief Construct a new Options object
+     */
+    Options() { }
+
+    /**
+     * @brief Check whether the parameters in Options struct is valid
+     *
+     * @return true if all the parameters are valid
+     *         otherwise false
+     */
+    bool check() const;
+};
+
+/**
+ * @brief Per-call statistics of a benchmark, in nanoseconds
+ */
+struct Result {
+    std::string name;
+    std::string input;
+    int64_t calls;
+    double mean, stddev, min, median, p90, max;
+};
+
+/**
+ * @brief Pin the calling thread to a core (Linux only)
+ *
+ * @return true if the thread was pinned
+ *         otherwise false
+ */
+bool pin(int cpu);
+
+/**
+ * @brief Describe the frequency scaling of a core, e.g. "performance 3600 MHz"
+ *
+ * @details The governor is only reported, changing it needs root. Anything else than
+ * "performance" makes results noisy.
+ */
+std::string cpu_frequency(int cpu);
+
+/**
+ * @brief Keep the compiler from optimizing away a value
+ */
+template <class T>
+void do_not_optimize(const T& value);
+
+/**
+ * @brief Make a fixed BGR test frame: moving colored circles over a noisy background
+ *
+ * @param size Frame size
+ * @param seed Same seed, same frame
+ */
+cv::Mat synthetic_frame(cv::Size size, uint64_t seed = 1);
+
+/**
+ * @brief The standard input sizes: 480p, 720p, 1080p and 4K
+ */
+std::vector<std::pair<std::string, cv::Size>> sizes();
+
+/**
+ * @brief Collects, runs and reports benchmarks
+ */
+class Suite {
+    Options _opt;
+    std::vector<Result> _results;
+
+public:
+    /**
+     * @brief Construct a new Suite object, pinning the thread if requested
+     *
+     * @throw std::invalid_argument if the options are invalid
+     */
+    explicit Suite(const Options& opt = Options());
+
+    /**
+     * @brief Measure f and record the result
+     *
+     * @param name Name of the benchmark
+     * @param input Label of the input, e.g. "1080p"
+     * @param f Function to benchmark
+     */
+    template <typename F>
+    void run(const std::string& name, const std::string& input, F&& f);
+
+    const std::vector<Result>& results() const;
+
+    /**
+     * @brief Print the results as a table
+     */
+    void print(std::ostream& os = std::cout) const;
+
+    /**
+     * @brief Write the results to a tab-separated file, one line per benchmark
+     *
+     * @details Lines starting with '#' describe the run (date, pinned core, frequency scaling).
+     */
+    void write(const std::string& path = "bench_output.txt") const;
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline bool pin(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+inline std::string cpu_frequency(int cpu)
+{
+#ifdef __linux__
+    const std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(std::max(cpu, 0))
+        + "/cpufreq/";
+    std::string governor;
+    long khz = 0;
+    std::ifstream(dir + "scaling_governor") >> governor;
+    std::ifstream(dir + "scaling_cur_freq") >> khz;
+    if (governor.empty()) {
+        return "unknown";
+    }
+    return governor + " " + std::to_string(khz / 1000) + " MHz";
+#else
+    (void)cpu;
+    return "unknown";
+#endif
+}
+
+template <class T>
+inline void do_not_optimize(const T& value)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+inline cv::Mat synthetic_frame(cv::Size size, uint64_t seed)
+{
+    const int r = std::min(size.width, size.height) / 10;
+    SyntheticSource src(size,
+        { { cv::Point(size.width / 4, size.height / 3), r, cv::Scalar(40, 40, 220), cv::Point(7, 5) },
+            { cv::Point(size.width / 2, size.height / 2), r / 2, cv::Scalar(40, 200, 40), cv::Point(-3, 4) },
+            { cv::Point(3 * size.width / 4, 2 * size.height / 3), r / 3, cv::Scalar(220, 60, 30), cv::Point(5, -6) } },
+        0, cv::Scalar(90, 110, 100));
+    cv::Mat img;
+    src.render(seed, img);
+
+    // fixed noise so that thresholds see realistic, non-uniform pixels
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    for (int y = 0; y < img.rows; y++) {
+        uchar* p = img.ptr<uchar>(y);
+        for (int x = 0; x < img.cols * 3; x++) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            p[x] = cv::saturate_cast<uchar>(p[x] + static_cast<int>(state >> 59) - 16);
+        }
+    }
+    return img;
+}
+
+inline std::vector<std::pair<std::string, cv::Size>> sizes()
+{
+    return { { "480p", cv::Size(640, 480) }, { "720p", cv::Size(1280, 720) },
+        { "1080p", cv::Size(1920, 1080) }, { "4K", cv::Size(3840, 2160) } };
+}
+
+inline bool Options::check() const
+{
+    return warmup >= 0 && repeats >= 1;
+}
+
+inline Suite::Suite(const Options& opt)
+    : _opt(opt)
+{
+    if (!_opt.check()) {
+        throw std::invalid_argument("Invalid bench options.");
+    }
+    if (_opt.cpu >= 0 && !pin(_opt.cpu)) {
+        std::cerr << "bench: could not pin to cpu " << _opt.cpu << "\n";
+    }
+    const std::string freq = cpu_frequency(_opt.cpu);
+    if (freq.compare(0, 11, "performance") != 0) {
+        std::cerr << "bench: cpu frequency scaling is \"" << freq
+                  << "\", results may be noisy\n";
+    }
+}
+
+template <typename F>
+void Suite::run(const std::string& name, const std::string& input, F&& f)
+{
+    if (!_opt.filter.empty() && (name + " " + input).find(_opt.filter) == std::string::npos) {
+        return;
+    }
+    using clock = std::chrono::steady_clock;
+    for (int i = 0; i < _opt.warmup; i++) {
+        f();
+    }
+
+    // grow the batch until it is long enough to time reliably
+    int64_t batch = 1;
+    while (true) {
+        const clock::time_point t0 = clock::now();
+        for (int64_t i = 0; i < batch; i++) {
+            f();
+        }
+        if (clock::now() - t0 >= _opt.min_batch || batch >= (int64_t(1) << 30)) {
+            break;
+        }
+        batch *= 2;
+    }
+
+    std::vector<double> samples;
+    for (int r = 0; r < _opt.repeats; r++) {
+        const clock::time_point t0 = clock::now();
+        for (int64_t i = 0; i < batch; i++) {
+            f();
+        }
+        samples.push_back(std::chrono::duration<double, std::nano>(clock::now() - t0).count() / batch);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    Result res;
+    res.name = name;
+    res.input = input;
+    res.calls = batch * _opt.repeats;
+    res.mean = 0;
+    for (double s : samples) {
+        res.mean += s;
+    }
+    res.mean /= samples.size();
+    double var = 0;
+    for (double s : samples) {
+        var += (s - res.mean) * (s - res.mean);
+    }
+    res.stddev = samples.size() > 1 ? std::sqrt(var / (samples.size() - 1)) : 0;
+    res.min = samples.front();
+    res.median = samples[samples.size() / 2];
+    res.p90 = samples[std::min(samples.size() - 1, samples.size() * 9 / 10)];
+    res.max = samples.back();
+    _results.push_back(res);
+    std::cout << name << " [" << input << "]: " << res.median / 1e3 << " us\n";
+}
+
+inline const std::vector<Result>& Suite::results() const
+{
+    return _results;
+}
+
+inline void Suite::print(std::ostream& os) const
+{
+    const std::ios::fmtflags flags = os.flags();
+    os << std::left << std::setw(32) << "benchmark" << std::setw(8) << "input" << std::right
+       << std::setw(12) << "median us" << std::setw(12) << "mean us" << std::setw(10) << "stddev"
+       << std::setw(12) << "min us" << std::setw(12) << "p90 us" << "\n";
+    os << std::fixed << std::setprecision(3);
+    for (const Result& r : _results) {
+        os << std::left << std::setw(32) << r.name << std::setw(8) << r.input << std::right
+           << std::setw(12) << r.median / 1e3 << std::setw(12) << r.mean / 1e3
+           << std::setw(9) << (r.mean > 0 ? 100 * r.stddev / r.mean : 0) << "%"
+           << std::setw(12) << r.min / 1e3 << std::setw(12) << r.p90 / 1e3 << "\n";
+    }
+    os.flags(flags);
+}
+
+inline void Suite::write(const std::string& path) const
+{
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Cannot open " + path + " for writing.");
+    }
+    const std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+    out << "# date\t" << date << "\n";
+    out << "# cpu\t" << _opt.cpu << "\n";
+    out << "# frequency\t" << cpu_frequency(_opt.cpu) << "\n";
+    out << "# threads\t" << std::thread::hardware_concurrency() << "\n";
+    out << "name\tinput\tcalls\tmean_ns\tstddev_ns\tmin_ns\tmedian_ns\tp90_ns\tmax_ns\n";
+    out << std::fixed << std::setprecision(1);
+    for (const Result& r : _results) {
+        out << r.name << "\t" << r.input << "\t" << r.calls << "\t" << r.mean << "\t"
+            << r.stddev << "\t" << r.min << "\t" << r.median << "\t" << r.p90 << "\t"
+            << r.max << "\n";
+    }
+}
+
+} // namespace bench
+
+#endif // INCLUDE_PKG_BENCH_HPP
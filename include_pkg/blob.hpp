@@ -0,0 +1,509 @@
+#ifndef INCLUDE_PKG_BLOB_HPP
+#define INCLUDE_PKG_BLOB_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <include_pkg/circle_fit.hpp>
+
+/**
+ * @brief Moments of a connected group of pixels
+ */
+struct Blob {
+    /**
+     * @brief Count of pixels
+     */
+    int64_t cnt = 0;
+
+    /**
+     * @brief Sum of X-coordinates of pixels
+     */
+    int64_t totX = 0;
+
+    /**
+     * @brief Sum of Y-coordinates of pixels
+     */
+    int64_t totY = 0;
+
+    /**
+     * @brief Bounding box, inclusive
+     */
+    int x0 = 0, y0 = 0, x1 = -1, y1 = -1;
+
+    /**
+     * @brief Add a horizontal run of pixels [x0, x1) on row y
+     */
+    void add_run(int y, int x0, int x1);
+
+    /**
+     * @brief Merge the moments of another group into this one
+     */
+    void merge(const Blob& other);
+
+    /**
+     * @brief Get the centroid of the group
+     */
+    cv::Point center() const;
+
+    /**
+     * @brief Get the radius of the circle with the same area as the group
+     */
+    int radius() const;
+
+    /**
+     * @brief Get the bounding box of the group
+     */
+    cv::Rect rect() const;
+};
+
+/**
+ * @brief Single-pass connected-component labeling of binary masks
+ *
+ * @details Each row of the mask is run-length encoded and the runs are linked to the 8-connected
+ * runs of the previous row with union-find. Moments are accumulated per label while scanning, so
+ * only the runs of two rows are kept and no per-pixel label image is ever written.
+ * The buffers are kept between calls; after the first few frames labeling does not allocate.
+ */
+class BlobLabeler {
+public:
+    /**
+     * @brief Horizontal run of non-zero pixels [x0, x1)
+     */
+    struct Run {
+        int x0, x1;
+
+        /**
+         * @brief Index of the group the run belongs to
+         */
+        int label;
+
+        /**
+         * @brief Value of the pixels of the run, 0 unless labeled with label_values
+         */
+        uchar value = 0;
+    };
+
+private:
+    std::vector<Run> _prev;
+    std::vector<Run> _cur;
+    std::vector<Run> _first;
+    std::vector<int> _parent;
+    std::vector<Blob> _stats;
+    std::vector<Blob> _blobs;
+    std::vector<uchar> _label_values;
+    std::vector<uchar> _values;
+
+    bool _collect_edges;
+
+    /**
+     * @brief Every run of the last mask with its row, kept only if edges are collected
+     */
+    std::vector<std::pair<int, Run>> _edges;
+    std::vector<cv::Point2d> _points;
+
+    int _find(int label);
+    int _unite(int a, int b);
+
+    /**
+     * @brief Append the runs of non-zero pixels of a row
+     */
+    static void _runs(const uchar* row, int cols, std::vector<Run>& out);
+
+    /**
+     * @brief Append the runs of equal non-zero pixels of a row
+     */
+    static void _value_runs(const uchar* row, int cols, std::vector<Run>& out);
+
+    const std::vector<Blob>& _label(const cv::Mat& mask, int y_offset, bool by_value);
+
+public:
+    /**
+     * @brief Construct a new BlobLabeler object
+     *
+     * @param collect_edges Keep the runs of every row so that circles can be fitted to the groups
+     */
+    explicit BlobLabeler(bool collect_edges = false);
+
+    /**
+     * @brief Find every 8-connected group of non-zero pixels
+     *
+     * @param mask 8-bit single channel mask
+     * @param y_offset Added to every row index, for masks that are a band of a bigger image
+     * @return const std::vector<Blob>& The groups, valid until the next call
+     */
+    const std::vector<Blob>& label(const cv::Mat& mask, int y_offset = 0);
+
+    /**
+     * @brief Find every 8-connected group of pixels with the same non-zero value
+     *
+     * @details For class maps, where each non-zero value is a class id; pixels of different
+     * classes are never joined, even if they touch. All classes are labeled in a single pass.
+     *
+     * @param mask 8-bit single channel class map
+     * @param y_offset Added to every row index
+     * @return const std::vector<Blob>& The groups, valid until the next call
+     */
+    const std::vector<Blob>& label_values(const cv::Mat& mask, int y_offset = 0);
+
+    /**
+     * @brief Get the pixel value of every group of the last mask labeled with label_values
+     *
+     * @details Indexed like the vector returned by label_values.
+     */
+    const std::vector<uchar>& values() const;
+
+    /**
+     * @brief Get the runs of the first row of the last labeled mask
+     *
+     * @details Labels are indices into the vector returned by label(). Used to join groups
+     * across the seams of masks labeled band by band.
+     */
+    const std::vector<Run>& first_row() const;
+
+    /**
+     * @brief Get the runs of the last row of the last labeled mask
+     *
+     * @details Labels are indices into the vector returned by label().
+     */
+    const std::vector<Run>& last_row() const;
+
+    /**
+     * @brief Find the biggest 8-connected group of non-zero pixels
+     *
+     * @param mask 8-bit single channel mask
+     * @return Blob The biggest group (cnt is 0 if the mask is empty)
+     */
+    Blob largest(const cv::Mat& mask);
+
+    /**
+     * @brief Fit a circle to the left and right ends of the rows of a group of the last mask
+     *
+     * @details Each row of the group contributes its leftmost and rightmost ends, so holes do not
+     * matter. The ends of a row [x0, x1) are taken at x0 - 0.5 and x1 - 0.5, the pixel borders,
+     * so the fit does not lose the half pixel a fit to pixel centers would. Only the runs kept
+     * while labeling are read; the mask is not scanned again.
+     *
+     * @param index Index of the group in the vector returned by label()
+     * @param method Fitting method
+     * @return CircleFit The circle (valid is false if too few points)
+     */
+    CircleFit fit_circle(size_t index, CircleFit::Method method = CircleFit::Method::Taubin);
+};
+
+/**
+ * @brief Find the biggest 8-connected group of non-zero pixels with a per-thread labeler
+ *
+ * @param mask 8-bit single channel mask
+ * @return Blob The biggest group (cnt is 0 if the mask is empty)
+ */
+Blob largest_blob(const cv::Mat& mask);
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline void Blob::add_run(int y, int rx0, int rx1)
+{
+    const int64_t len = rx1 - rx0;
+    if (cnt == 0) {
+        x0 = rx0;
+        x1 = rx1 - 1;
+        y0 = y1 = y;
+    } else {
+        x0 = std::min(x0, rx0);
+        x1 = std::max(x1, rx1 - 1);
+        y0 = std::min(y0, y);
+        y1 = std::max(y1, y);
+    }
+    cnt += len;
+    totX += (static_cast<int64_t>(rx0) + rx1 - 1) * len / 2;
+    totY += static_cast<int64_t>(y) * len;
+}
+
+inline void Blob::merge(const Blob& o)
+{
+    if (o.cnt == 0) {
+        return;
+    }
+    if (cnt == 0) {
+        *this = o;
+        return;
+    }
+    cnt += o.cnt;
+    totX += o.totX;
+    totY += o.totY;
+    x0 = std::min(x0, o.x0);
+    y0 = std::min(y0, o.y0);
+    x1 = std::max(x1, o.x1);
+    y1 = std::max(y1, o.y1);
+}
+
+inline cv::Point Blob::center() const
+{
+    if (cnt == 0) {
+        return cv::Point();
+    }
+    return cv::Point(static_cast<int>(totX / cnt), static_cast<int>(totY / cnt));
+}
+
+inline int Blob::radius() const
+{
+    return static_cast<int>(std::lround(std::sqrt(cnt / CV_PI)));
+}
+
+inline cv::Rect Blob::rect() const
+{
+    return cv::Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+}
+
+inline int BlobLabeler::_find(int label)
+{
+    while (_parent[label] != label) {
+        _parent[label] = _parent[_parent[label]];
+        label = _parent[label];
+    }
+    return label;
+}
+
+inline int BlobLabeler::_unite(int a, int b)
+{
+    a = _find(a);
+    b = _find(b);
+    if (a == b) {
+        return a;
+    }
+    if (b < a) {
+        std::swap(a, b);
+    }
+    _parent[b] = a;
+    _stats[a].merge(_stats[b]);
+    return a;
+}
+
+inline void BlobLabeler::_runs(const uchar* row, int cols, std::vector<Run>& out)
+{
+    int x = 0;
+    while (x < cols) {
+        // skip background 8 pixels at a time
+        while (x + 8 <= cols) {
+            uint64_t word;
+            std::memcpy(&word, row + x, 8);
+            if (word != 0) {
+                break;
+            }
+            x += 8;
+        }
+        while (x < cols && row[x] == 0) {
+            x++;
+        }
+        if (x == cols) {
+            break;
+        }
+        const int start = x;
+        while (x < cols && row[x] != 0) {
+            x++;
+        }
+        out.push_back(Run { start, x, -1 });
+    }
+}
+
+inline BlobLabeler::BlobLabeler(bool collect_edges)
+    : _collect_edges(collect_edges)
+{
+}
+
+inline void BlobLabeler::_value_runs(const uchar* row, int cols, std::vector<Run>& out)
+{
+    int x = 0;
+    while (x < cols) {
+        while (x + 8 <= cols) {
+            uint64_t word;
+            std::memcpy(&word, row + x, 8);
+            if (word != 0) {
+                break;
+            }
+            x += 8;
+        }
+        while (x < cols && row[x] == 0) {
+            x++;
+        }
+        if (x == cols) {
+            break;
+        }
+        const int start = x;
+        const uchar value = row[x];
+        while (x < cols && row[x] == value) {
+            x++;
+        }
+        out.push_back(Run { start, x, -1, value });
+    }
+}
+
+inline const std::vector<Blob>& BlobLabeler::label(const cv::Mat& mask, int y_offset)
+{
+    return _label(mask, y_offset, false);
+}
+
+inline const std::vector<Blob>& BlobLabeler::label_values(const cv::Mat& mask, int y_offset)
+{
+    return _label(mask, y_offset, true);
+}
+
+inline const std::vector<uchar>& BlobLabeler::values() const
+{
+    return _values;
+}
+
+inline const std::vector<Blob>& BlobLabeler::_label(const cv::Mat& mask, int y_offset, bool by_value)
+{
+    if (mask.type() != CV_8UC1) {
+        throw std::invalid_argument("BlobLabeler expects an 8-bit single channel mask.");
+    }
+    _prev.clear();
+    _first.clear();
+    _parent.clear();
+    _stats.clear();
+    _blobs.clear();
+    _label_values.clear();
+    _values.clear();
+    _edges.clear();
+
+    for (int y = 0; y < mask.rows; y++) {
+        _cur.clear();
+        if (by_value) {
+            _value_runs(mask.ptr<uchar>(y), mask.cols, _cur);
+        } else {
+            _runs(mask.ptr<uchar>(y), mask.cols, _cur);
+        }
+
+        // both run lists are sorted; sweep them together
+        size_t p = 0;
+        for (Run& run : _cur) {
+            while (p < _prev.size() && _prev[p].x1 < run.x0) {
+                p++;
+            }
+            for (size_t q = p; q < _prev.size() && _prev[q].x0 <= run.x1; q++) {
+                if (_prev[q].value != run.value) {
+                    continue;
+                }
+                run.label = run.label < 0 ? _find(_prev[q].label) : _unite(run.label, _prev[q].label);
+            }
+            if (run.label < 0) {
+                run.label = static_cast<int>(_parent.size());
+                _parent.push_back(run.label);
+                _stats.emplace_back();
+                _label_values.push_back(run.value);
+            }
+            _stats[_find(run.label)].add_run(y + y_offset, run.x0, run.x1);
+            if (_collect_edges) {
+                _edges.emplace_back(y + y_offset, run);
+            }
+        }
+        if (y == 0) {
+            _first = _cur;
+        }
+        std::swap(_prev, _cur);
+    }
+
+    // number the roots and point every label at its root's number
+    for (size_t i = 0; i < _parent.size(); i++) {
+        if (_parent[i] == static_cast<int>(i)) {
+            _blobs.push_back(_stats[i]);
+            _values.push_back(_label_values[i]);
+        }
+    }
+    int next = 0;
+    for (size_t i = 0; i < _parent.size(); i++) {
+        if (_parent[i] == static_cast<int>(i)) {
+            _parent[i] = -1 - next++;
+        }
+    }
+    auto index = [this](int label) {
+        while (_parent[label] >= 0) {
+            label = _parent[label];
+        }
+        return -1 - _parent[label];
+    };
+    for (Run& run : _first) {
+        run.label = index(run.label);
+    }
+    for (Run& run : _prev) {
+        run.label = index(run.label);
+    }
+    for (auto& edge : _edges) {
+        edge.second.label = index(edge.second.label);
+    }
+    return _blobs;
+}
+
+inline const std::vector<BlobLabeler::Run>& BlobLabeler::first_row() const
+{
+    return _first;
+}
+
+inline const std::vector<BlobLabeler::Run>& BlobLabeler::last_row() const
+{
+    return _prev;
+}
+
+inline Blob BlobLabeler::largest(const cv::Mat& mask)
+{
+    Blob best;
+    for (const Blob& b : label(mask)) {
+        if (b.cnt > best.cnt) {
+            best = b;
+        }
+    }
+    return best;
+}
+
+inline CircleFit BlobLabeler::fit_circle(size_t index, CircleFit::Method method)
+{
+    if (!_collect_edges) {
+        throw std::logic_error("BlobLabeler::fit_circle needs a labeler that collects edges.");
+    }
+    if (index >= _blobs.size()) {
+        throw std::out_of_range("BlobLabeler::fit_circle index out of range.");
+    }
+    // only the outermost ends of each row, so that holes in the group do not add inner points
+    _points.clear();
+    int row = 0, x0 = 0, x1 = 0;
+    bool open = false;
+    for (const auto& edge : _edges) {
+        if (edge.second.label != static_cast<int>(index)) {
+            continue;
+        }
+        if (open && edge.first == row) {
+            x1 = edge.second.x1;
+            continue;
+        }
+        if (open) {
+            _points.emplace_back(x0 - 0.5, row);
+            _points.emplace_back(x1 - 0.5, row);
+        }
+        row = edge.first;
+        x0 = edge.second.x0;
+        x1 = edge.second.x1;
+        open = true;
+    }
+    if (open) {
+        _points.emplace_back(x0 - 0.5, row);
+        _points.emplace_back(x1 - 0.5, row);
+    }
+    return ::fit_circle(_points, method);
+}
+
+inline Blob largest_blob(const cv::Mat& mask)
+{
+    thread_local BlobLabeler labeler;
+    return labeler.largest(mask);
+}
+
+#endif // INCLUDE_PKG_BLOB_HPP
@@ -0,0 +1,146 @@
+#ifndef INCLUDE_PKG_CIRCLE_FIT_HPP
+#define INCLUDE_PKG_CIRCLE_FIT_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/**
+ * @brief Circle fitted to boundary points with subpixel precision
+ */
+struct CircleFit {
+    enum class Method {
+        /**
+         * @brief Linear least squares (Kåsa), biased towards smaller circles on short arcs
+         */
+        Kasa,
+
+        /**
+         * @brief Gradient-weighted algebraic fit (Taubin), nearly unbiased for a few Newton steps more
+         */
+        Taubin
+    };
+
+    cv::Point2d center;
+    double radius = 0;
+
+    /**
+     * @brief Root mean square distance of the points to the circle
+     */
+    double rms = 0;
+
+    /**
+     * @brief Whether there were enough points that are not on a line
+     */
+    bool valid = false;
+};
+
+/**
+ * @brief Fit a circle to a set of points
+ *
+ * @details The points are centered on their mean before the moments are taken, so the fit stays
+ * accurate for circles far from the origin. Taubin's fit follows Chernov's implementation: the
+ * smallest root of the characteristic polynomial is found with Newton steps started at 0.
+ *
+ * @param points At least three points, not all on a line
+ * @param method Fitting method
+ * @return CircleFit The circle (valid is false if the points do not define one)
+ */
+CircleFit fit_circle(const std::vector<cv::Point2d>& points,
+    CircleFit::Method method = CircleFit::Method::Taubin);
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline CircleFit fit_circle(const std::vector<cv::Point2d>& points, CircleFit::Method method)
+{
+    CircleFit out;
+    const size_t count = points.size();
+    if (count < 3) {
+        return out;
+    }
+
+    double mx = 0, my = 0;
+    for (const cv::Point2d& p : points) {
+        mx += p.x;
+        my += p.y;
+    }
+    mx /= count;
+    my /= count;
+
+    double Mxx = 0, Myy = 0, Mxy = 0, Mxz = 0, Myz = 0, Mzz = 0;
+    for (const cv::Point2d& p : points) {
+        const double x = p.x - mx, y = p.y - my;
+        const double xx = x * x, yy = y * y, z = xx + yy;
+        Mxx += xx;
+        Myy += yy;
+        Mxy += x * y;
+        Mxz += x * z;
+        Myz += y * z;
+        Mzz += z * z;
+    }
+    const double n = static_cast<double>(count);
+    Mxx /= n;
+    Myy /= n;
+    Mxy /= n;
+    Mxz /= n;
+    Myz /= n;
+    Mzz /= n;
+
+    const double Mz = Mxx + Myy;
+    const double Cov_xy = Mxx * Myy - Mxy * Mxy;
+    if (!(Cov_xy > 1e-12 * Mz * Mz)) {
+        return out;
+    }
+
+    // root of the characteristic polynomial; Kåsa's fit is the same formula at 0
+    double root = 0;
+    if (method == CircleFit::Method::Taubin) {
+        const double Var_z = Mzz - Mz * Mz;
+        const double A3 = 4 * Mz;
+        const double A2 = -3 * Mz * Mz - Mzz;
+        const double A1 = Var_z * Mz + 4 * Cov_xy * Mz - Mxz * Mxz - Myz * Myz;
+        const double A0 = Mxz * (Mxz * Myy - Myz * Mxy) + Myz * (Myz * Mxx - Mxz * Mxy) - Var_z * Cov_xy;
+        const double A22 = A2 + A2;
+        const double A33 = A3 + A3 + A3;
+
+        double value = A0;
+        for (int i = 0; i < 20; i++) {
+            const double slope = A1 + root * (A22 + A33 * root);
+            const double next = root - value / slope;
+            if (next == root || !std::isfinite(next)) {
+                break;
+            }
+            const double next_value = A0 + next * (A1 + next * (A2 + next * A3));
+            if (std::fabs(next_value) >= std::fabs(value)) {
+                break;
+            }
+            root = next;
+            value = next_value;
+        }
+    }
+
+    const double det = root * root - root * Mz + Cov_xy;
+    const double cx = (Mxz * (Myy - root) - Myz * Mxy) / det / 2;
+    const double cy = (Myz * (Mxx - root) - Mxz * Mxy) / det / 2;
+    const double r2 = cx * cx + cy * cy + Mz;
+    if (!std::isfinite(r2) || r2 <= 0) {
+        return out;
+    }
+
+    out.center = cv::Point2d(cx + mx, cy + my);
+    out.radius = std::sqrt(r2);
+    double sq = 0;
+    for (const cv::Point2d& p : points) {
+        const double d = std::hypot(p.x - out.center.x, p.y - out.center.y) - out.radius;
+        sq += d * d;
+    }
+    out.rms = std::sqrt(sq / n);
+    out.valid = true;
+    return out;
+}
+
+#endif // INCLUDE_PKG_CIRCLE_FIT_HPP
@@ -6,74 +6,20 @@
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 #include <utility>
-#include <stack>
 #include <vector>
 
 #include <opencv2/imgproc.hpp>
 #include <opencv2/core.hpp>
 
-
-// namespace {
-// /**
-//  * @brief Struct to represent a group of pixels.
-//  *
-//  * @details This struct holds information about a group of pixels, including
-//  * the sum of their x and y coordinates and the count of pixels.
-//  */
-// struct Group {
-//     /**
-//      * @brief Sum of X-coordinates of pixels
-//      */
-//     int totX = 0;
-//  
-//     /**
-//      * @brief Sum of Y-coordinates of pixels
-//      */
-//     int totY = 0;
-//    
-//     /**
-//      * @brief Count of pixels
-//      */
-//     int cnt = 0;
-//
-//     /**
-//      * @brief Construct a new Group object
-//      * 
-//      * @param _totX Sum of X-coordinates of pixels
-//      * @param _totY Sum of Y-coordinates of pixels
-//      * @param _cnt Count of pixels
-//      */
-//     Group(int _totX, int _totY, int _cnt)
-//         : totX(_totX)
-//         , totY(_totY)
-//         , cnt(_cnt)
-//     {
-//     }
-// };
-// /**
-//  * @brief Depth First Search algorithm for circle detection.
-//  *
-//  * @details This function uses DFS to detect connected components representing circles
-//  * in the given image.
-//  *
-//  * @param image Grayscale image
-//  * @param x X-coordinate of the pixel
-//  * @param y Y-coordinate of the pixel
-//  * @param s Stack for DFS
-//  * @param belongsto Vector to show which group each pixel belongs to
-//  * @param groups Vector of groups
-//  * @param largestGroupIndex Index of the largest detected group
-//  */
-// void myCircleDetector_dfs(const cv::Mat& image, int x, int y,
-//     std::vector<std::pair<int, int>>& s,
-//     std::vector<int>& belongsto,
-//     std::vector<Group>& groups, int& largestGroupIndex);
-//
-// void myCircleDetector(const cv::Mat& image, std::vector<cv::Vec3f>& output);
-// }
+#include <include_pkg/ColorLut.hpp>
+#include <include_pkg/Profiler.hpp>
+#include <include_pkg/blob.hpp>
+#include <include_pkg/circle_fit.hpp>
+#include <include_pkg/hsv.hpp>
 
 /**
  * @brief Finds the mask that contains the acceptable colors.
@@ -90,6 +36,35 @@
 cv::Mat color_mask(const cv::Mat& image, cv::Scalar color, int hue_range,
     int saturation_range, int value_range);
 
+/**
+ * @brief Finds the mask that contains the acceptable colors into a reusable buffer.
+ * 
+ * @details Same result as the function above, but the HSV conversion and the thresholding are
+ *  fused into a single pass (see hsv::threshold), so no HSV image is allocated and the mask
+ *  buffer is reused across frames. Hue ranges wrapping around 0 (reds) are handled.
+ * 
+ * @param image BGR image that the accepted color mask will be found.
+ * @param mask The output mask, reallocated only if the image size changes
+ * @param color Desired color in (B, G, R) order. HSV convertion is done inside the function.
+ * @param hue_range Hue range
+ * @param saturation_range Saturation range
+ * @param value_range Value range 
+*/
+void color_mask(const cv::Mat& image, cv::Mat& mask, cv::Scalar color, int hue_range,
+    int saturation_range, int value_range);
+
+/**
+ * @brief Finds the mask that contains the acceptable colors using a precomputed lookup table.
+ * 
+ * @details Build the table once per parameter set (e.g. from read_params) and reuse it for every
+ *  frame; each pixel then costs a single lookup instead of an HSV conversion.
+ * 
+ * @param image BGR image that the accepted color mask will be found.
+ * @param mask The output mask, reallocated only if the image size changes
+ * @param lut Lookup table built for the desired color and ranges
+*/
+void color_mask(const cv::Mat& image, cv::Mat& mask, const ColorLut& lut);
+
 /**
  * @brief Read integers from specified file
  * 
@@ -116,6 +91,38 @@ std::pair<cv::Point, int> detect_color(const cv::Mat& image,
     cv::Mat& hue_image = const_cast<cv::Mat&>(static_cast<const cv::Mat&>(cv::Mat())),
     std::string path = std::string());
 
+/**
+ * @brief Finds the biggest group of specified color with already parsed parameters
+ * 
+ * @details The mask is computed with the fused HSV kernel into hue_image and the biggest group is
+ * found with a single streaming connected-component pass (see BlobLabeler). Both reuse their
+ * buffers, so no heap allocation happens per frame once the frame size is stable.
+ * 
+ * @param image The input image
+ * @param hue_image The output mask where the detected color is masked, reused across calls
+ * @param params Color detection parameters as returned by read_params
+ * @return A pair containing the center and radius of the detected group (radius 0 if none)
+ */
+std::pair<cv::Point, int> detect_color(const cv::Mat& image, cv::Mat& hue_image,
+    const std::tuple<cv::Scalar, int, int, int>& params);
+
+/**
+ * @brief Finds the biggest group of specified color and fits a circle to its border
+ * 
+ * @details Same search as detect_color, but the runs found while labeling are kept and a circle is
+ * fitted to their ends, giving the center and radius with subpixel precision. Unlike the area
+ * based radius of detect_color, the fit is not thrown off by holes in the mask (e.g. highlights).
+ * 
+ * @param image The input image
+ * @param hue_image The output mask where the detected color is masked, reused across calls
+ * @param params Color detection parameters as returned by read_params
+ * @param method Fitting method
+ * @return CircleFit The fitted circle (valid is false if no group was found)
+ */
+CircleFit detect_color_fit(const cv::Mat& image, cv::Mat& hue_image,
+    const std::tuple<cv::Scalar, int, int, int>& params,
+    CircleFit::Method method = CircleFit::Method::Taubin);
+
 /**
  * @brief Detects circles in the given image.
  * 
@@ -132,4 +139,338 @@ std::pair<cv::Point, int> detect_circle(const cv::Mat& img, int minR = 0,
     int maxR = 0, int param1 = 100,
     int param2 = 100);
 
+/**
+ * @brief Detects circles in the given image coarse-to-fine.
+ * 
+ * @details The Hough Circle transform is first run on an image downscaled by 2^levels, with the
+ * radius range and the accumulator threshold scaled accordingly. The strongest circle is then
+ * refined at full resolution in a small window around it, searching only radii within one
+ * coarse pixel of the estimate. If the refinement finds nothing, the coarse estimate is returned.
+ * 
+ * @param img The input image (BGR or grayscale)
+ * @param levels The number of pyramid levels (0 runs only the full resolution search)
+ * @param minR The minimum radius of the circles to be detected
+ * @param maxR The maximum radius of the circles to be detected
+ * @param param1 The first parameter of the Hough Circle algorithm
+ * @param param2 The second parameter of the Hough Circle algorithm (at full resolution; scaled down
+ *        for the coarse search, but never below 8)
+ * @return A pair containing the center point and radius of the circle (radius 0 if none)
+ * @throw std::invalid_argument if levels is negative or the image downscaled by 2^levels is
+ *        smaller than 5x5
+ */
+std::pair<cv::Point, int> detect_circle_pyramid(const cv::Mat& img, int levels = 2,
+    int minR = 0, int maxR = 0, int param1 = 100, int param2 = 100);
+
+/**
+ * @brief Owns every intermediate buffer of the detectors so that frames can be processed without allocating
+ * 
+ * @details The buffers are sized on the first frame and reused while the frame size stays the
+ * same. The labeler vectors grow with the number of runs and groups, so once the busiest frame
+ * has been seen the color detections do not touch the heap at all (checked by test_alloc.cpp).
+ * The circle detections reuse the grayscale image, the pyramid levels, the blurred images and
+ * the circle list, but cv::HoughCircles still allocates its accumulator internally.
+ * 
+ * A context is not thread safe; use one per thread (the free functions above use a
+ * thread_local one where they need buffers).
+ */
+class DetectorContext {
+    cv::Mat _mask;
+    cv::Mat _gray;
+    std::vector<cv::Mat> _pyramid;
+
+    // backing store of the blurred images, whose size changes with the level and the window
+    cv::Mat _blurred;
+
+    std::vector<cv::Vec3f> _circles;
+    BlobLabeler _labeler;
+
+    // collects the blob edges for fit_circle; kept apart so that detect_color does not pay for them
+    BlobLabeler _fit_labeler;
+    cv::MatAllocator* _allocator;
+
+    Blob _largest(const std::vector<Blob>& blobs, size_t& index) const;
+
+public:
+    /**
+     * @brief Construct a new DetectorContext object
+     * 
+     * @param allocator Allocator of the buffers (nullptr for OpenCV's default), e.g. a MatPool
+     * that outlives the context
+     */
+    explicit DetectorContext(cv::MatAllocator* allocator = nullptr);
+
+    /**
+     * @brief Finds the mask that contains the acceptable colors, see color_mask
+     * 
+     * @return const cv::Mat& The mask, valid until the next call on this context
+     */
+    const cv::Mat& color_mask(const cv::Mat& image, cv::Scalar color, int hue_range,
+        int saturation_range, int value_range);
+
+    /**
+     * @brief Finds the mask that contains the acceptable colors using a lookup table, see color_mask
+     * 
+     * @return const cv::Mat& The mask, valid until the next call on this context
+     */
+    const cv::Mat& color_mask(const cv::Mat& image, const ColorLut& lut);
+
+    /**
+     * @brief Finds the biggest group of specified color, see detect_color
+     * 
+     * @param image The input image
+     * @param params Color detection parameters as returned by read_params
+     * @return A pair containing the center and radius of the detected group (radius 0 if none)
+     */
+    std::pair<cv::Point, int> detect_color(const cv::Mat& image,
+        const std::tuple<cv::Scalar, int, int, int>& params);
+
+    /**
+     * @brief Finds the biggest group of the color a lookup table accepts
+     * 
+     * @param image The input image
+     * @param lut Lookup table built for the desired color and ranges
+     * @return A pair containing the center and radius of the detected group (radius 0 if none)
+     */
+    std::pair<cv::Point, int> detect_color(const cv::Mat& image, const ColorLut& lut);
+
+    /**
+     * @brief Finds the biggest group of specified color and fits a circle to it, see detect_color_fit
+     */
+    CircleFit detect_color_fit(const cv::Mat& image,
+        const std::tuple<cv::Scalar, int, int, int>& params,
+        CircleFit::Method method = CircleFit::Method::Taubin);
+
+    /**
+     * @brief Detects circles in the given image, same as detect_circle_pyramid with no pyramid levels
+     */
+    std::pair<cv::Point, int> detect_circle(const cv::Mat& img, int minR = 0,
+        int maxR = 0, int param1 = 100, int param2 = 100);
+
+    /**
+     * @brief Detects circles in the given image coarse-to-fine, see detect_circle_pyramid
+     */
+    std::pair<cv::Point, int> detect_circle_pyramid(const cv::Mat& img, int levels = 2,
+        int minR = 0, int maxR = 0, int param1 = 100, int param2 = 100);
+
+    /**
+     * @brief Get the mask of the last color detection
+     */
+    const cv::Mat& mask() const;
+};
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+inline void color_mask(const cv::Mat& image, cv::Mat& mask, cv::Scalar color, int hue_range,
+    int saturation_range, int value_range)
+{
+    PROFILE_SCOPE("color_mask");
+    hsv::threshold(image, mask,
+        hsv::make_bounds(color, hue_range, saturation_range, value_range));
+}
+
+inline void color_mask(const cv::Mat& image, cv::Mat& mask, const ColorLut& lut)
+{
+    PROFILE_SCOPE("color_mask_lut");
+    lut.apply(image, mask);
+}
+
+inline std::pair<cv::Point, int> detect_color(const cv::Mat& image, cv::Mat& hue_image,
+    const std::tuple<cv::Scalar, int, int, int>& params)
+{
+    PROFILE_SCOPE("detect_color");
+    color_mask(image, hue_image, std::get<0>(params), std::get<1>(params),
+        std::get<2>(params), std::get<3>(params));
+    Blob blob;
+    {
+        PROFILE_SCOPE("largest_blob");
+        blob = largest_blob(hue_image);
+    }
+    return { blob.center(), blob.radius() };
+}
+
+inline CircleFit detect_color_fit(const cv::Mat& image, cv::Mat& hue_image,
+    const std::tuple<cv::Scalar, int, int, int>& params, CircleFit::Method method)
+{
+    PROFILE_SCOPE("detect_color_fit");
+    color_mask(image, hue_image, std::get<0>(params), std::get<1>(params),
+        std::get<2>(params), std::get<3>(params));
+    thread_local BlobLabeler labeler(true);
+    const std::vector<Blob>& blobs = labeler.label(hue_image);
+    size_t best = blobs.size();
+    for (size_t i = 0; i < blobs.size(); i++) {
+        if (best == blobs.size() || blobs[i].cnt > blobs[best].cnt) {
+            best = i;
+        }
+    }
+    if (best == blobs.size()) {
+        return CircleFit();
+    }
+    PROFILE_SCOPE("circle_fit");
+    return labeler.fit_circle(best, method);
+}
+
+inline std::pair<cv::Point, int> detect_circle_pyramid(const cv::Mat& img, int levels,
+    int minR, int maxR, int param1, int param2)
+{
+    thread_local DetectorContext ctx;
+    return ctx.detect_circle_pyramid(img, levels, minR, maxR, param1, param2);
+}
+
+inline DetectorContext::DetectorContext(cv::MatAllocator* allocator)
+    : _fit_labeler(true)
+    , _allocator(allocator)
+{
+    _mask.allocator = _gray.allocator = _blurred.allocator = allocator;
+}
+
+inline const cv::Mat& DetectorContext::mask() const
+{
+    return _mask;
+}
+
+inline const cv::Mat& DetectorContext::color_mask(const cv::Mat& image, cv::Scalar color,
+    int hue_range, int saturation_range, int value_range)
+{
+    ::color_mask(image, _mask, color, hue_range, saturation_range, value_range);
+    return _mask;
+}
+
+inline const cv::Mat& DetectorContext::color_mask(const cv::Mat& image, const ColorLut& lut)
+{
+    ::color_mask(image, _mask, lut);
+    return _mask;
+}
+
+inline Blob DetectorContext::_largest(const std::vector<Blob>& blobs, size_t& index) const
+{
+    index = blobs.size();
+    for (size_t i = 0; i < blobs.size(); i++) {
+        if (index == blobs.size() || blobs[i].cnt > blobs[index].cnt) {
+            index = i;
+        }
+    }
+    return index == blobs.size() ? Blob() : blobs[index];
+}
+
+inline std::pair<cv::Point, int> DetectorContext::detect_color(const cv::Mat& image,
+    const std::tuple<cv::Scalar, int, int, int>& params)
+{
+    PROFILE_SCOPE("detect_color");
+    color_mask(image, std::get<0>(params), std::get<1>(params), std::get<2>(params),
+        std::get<3>(params));
+    size_t index;
+    Blob blob;
+    {
+        PROFILE_SCOPE("largest_blob");
+        blob = _largest(_labeler.label(_mask), index);
+    }
+    return { blob.center(), blob.radius() };
+}
+
+inline std::pair<cv::Point, int> DetectorContext::detect_color(const cv::Mat& image,
+    const ColorLut& lut)
+{
+    PROFILE_SCOPE("detect_color");
+    color_mask(image, lut);
+    size_t index;
+    Blob blob;
+    {
+        PROFILE_SCOPE("largest_blob");
+        blob = _largest(_labeler.label(_mask), index);
+    }
+    return { blob.center(), blob.radius() };
+}
+
+inline CircleFit DetectorContext::detect_color_fit(const cv::Mat& image,
+    const std::tuple<cv::Scalar, int, int, int>& params, CircleFit::Method method)
+{
+    PROFILE_SCOPE("detect_color_fit");
+    color_mask(image, std::get<0>(params), std::get<1>(params), std::get<2>(params),
+        std::get<3>(params));
+    size_t index;
+    if (_largest(_fit_labeler.label(_mask), index).cnt == 0) {
+        return CircleFit();
+    }
+    PROFILE_SCOPE("circle_fit");
+    return _fit_labeler.fit_circle(index, method);
+}
+
+inline std::pair<cv::Point, int> DetectorContext::detect_circle(const cv::Mat& img, int minR,
+    int maxR, int param1, int param2)
+{
+    return detect_circle_pyramid(img, 0, minR, maxR, param1, param2);
+}
+
+inline std::pair<cv::Point, int> DetectorContext::detect_circle_pyramid(const cv::Mat& img,
+    int levels, int minR, int maxR, int param1, int param2)
+{
+    PROFILE_SCOPE("detect_circle_pyramid");
+    // pyrDown rounds up; the coarsest level must still hold the 5x5 median kernel
+    if (levels < 0) {
+        throw std::invalid_argument("Pyramid levels must not be negative.");
+    }
+    int coarse_rows = img.rows;
+    int coarse_cols = img.cols;
+    for (int i = 0; i < levels && coarse_rows >= 5 && coarse_cols >= 5; i++) {
+        coarse_rows = (coarse_rows + 1) / 2;
+        coarse_cols = (coarse_cols + 1) / 2;
+    }
+    if (coarse_rows < 5 || coarse_cols < 5) {
+        throw std::invalid_argument("Too many pyramid levels for the image size.");
+    }
+
+    // a grayscale input is used as is, never adopted into _gray, so it cannot be overwritten later
+    if (img.channels() == 3) {
+        cv::cvtColor(img, _gray, cv::COLOR_BGR2GRAY);
+    }
+    const cv::Mat& gray = img.channels() == 3 ? _gray : img;
+
+    // every level has its own buffer, so pyrDown never reallocates
+    while (_pyramid.size() < static_cast<size_t>(levels)) {
+        _pyramid.emplace_back();
+        _pyramid.back().allocator = _allocator;
+    }
+    for (int i = 0; i < levels; i++) {
+        cv::pyrDown(i == 0 ? gray : _pyramid[i - 1], _pyramid[i]);
+    }
+    const cv::Mat& coarse = levels == 0 ? gray : _pyramid[levels - 1];
+    const int scale = 1 << levels;
+
+    // edge votes grow with the circumference, so the threshold shrinks with the scale; the floor only
+    // guards the coarse levels, level 0 keeps the threshold of the caller
+    const int threshold = levels == 0 ? param2 : std::max(param2 / scale, 8);
+    std::vector<cv::Vec3f>& circles = _circles;
+    circles.clear();
+    _blurred.create(gray.rows, gray.cols, CV_8UC1);
+    cv::Mat blurred = _blurred(cv::Rect(0, 0, coarse.cols, coarse.rows));
+    cv::medianBlur(coarse, blurred, 5);
+    cv::HoughCircles(blurred, circles, cv::HOUGH_GRADIENT, 1, blurred.rows / 8., param1,
+        threshold, minR / scale, maxR > 0 ? std::max(maxR / scale, 1) : 0);
+    if (circles.empty()) {
+        return { cv::Point(), 0 };
+    }
+
+    const cv::Point center(cvRound(circles[0][0] * scale), cvRound(circles[0][1] * scale));
+    const int radius = cvRound(circles[0][2] * scale);
+    if (levels == 0) {
+        return { center, radius };
+    }
+
+    const int half = radius + 2 * scale + 4;
+    const cv::Rect window = cv::Rect(center.x - half, center.y - half, 2 * half + 1, 2 * half + 1)
+        & cv::Rect(0, 0, gray.cols, gray.rows);
+    blurred = _blurred(cv::Rect(0, 0, window.width, window.height));
+    cv::medianBlur(gray(window), blurred, 5);
+    circles.clear();
+    cv::HoughCircles(blurred, circles, cv::HOUGH_GRADIENT, 1, blurred.rows, param1, param2,
+        std::max(radius - scale, minR), maxR > 0 ? std::min(radius + scale, maxR) : radius + scale);
+    if (circles.empty()) {
+        return { center, radius };
+    }
+    return { cv::Point(cvRound(circles[0][0]) + window.x, cvRound(circles[0][1]) + window.y),
+        cvRound(circles[0][2]) };
+}
+
 #endif // DETECT_HPP
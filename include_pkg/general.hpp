@@ -2,19 +2,92 @@
 #define INCLUDE_PKG_GENERAL_HPP
 
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 
 namespace general {
 
 // format like printf
 // also see std::format (C++20)
+// std::string arguments can be given for %s
 template <typename... Args>
 std::string format(const std::string& format, Args... args);
 
+/**
+ * @brief Fixed-capacity string on the stack, the result of sformat
+ *
+ * @tparam N Capacity including the terminating '\0'
+ */
+template <size_t N>
+class StackString {
+    char _buf[N];
+    size_t _size;
+    bool _truncated;
+
+    template <size_t M, typename... Args>
+    friend StackString<M> sformat(const char* format, Args... args);
+
+public:
+    StackString();
+
+    const char* c_str() const;
+    size_t size() const;
+
+    /**
+     * @brief Check whether the formatted text did not fit and was cut
+     */
+    bool truncated() const;
+
+    std::string str() const;
+};
+
+/**
+ * @brief Format like printf into a caller-provided buffer, without allocating
+ *
+ * @param buf Output buffer, always null-terminated if size > 0
+ * @param size Size of the buffer
+ * @return int Length of the full formatted text (may be >= size if it was cut), or -1 on error
+ */
+template <typename... Args>
+int format_to(char* buf, size_t size, const char* format, Args... args);
+
+/**
+ * @brief Format like printf into a StackString, without allocating
+ */
+template <size_t N = 256, typename... Args>
+StackString<N> sformat(const char* format, Args... args);
+
+/*
+Checked variants: the format string must be a literal and is checked against the argument types
+at compile time, e.g. a %d given a double or a %ld given an int does not compile.
+  std::string s = GENERAL_FORMAT("%d px", r);
+  GENERAL_FORMAT_TO(buf, sizeof(buf), "%s: %.2f", name, fps);
+  auto line = GENERAL_SFORMAT("(%d, %d)", x, y); // StackString<256>
+*/
+#define GENERAL_FORMAT(...) \
+    (GENERAL_DETAIL_CHECK(__VA_ARGS__), ::general::format(__VA_ARGS__))
+
+#define GENERAL_FORMAT_TO(buf, size, ...) \
+    (GENERAL_DETAIL_CHECK(__VA_ARGS__), ::general::format_to(buf, size, __VA_ARGS__))
+
+#define GENERAL_SFORMAT(...) \
+    (GENERAL_DETAIL_CHECK(__VA_ARGS__), ::general::sformat(__VA_ARGS__))
+
+// the format string is the first of __VA_ARGS__, so a call without arguments is valid before C++20
+#define GENERAL_DETAIL_CHECK(...)                                                              \
+    ::general::detail::format_checked<decltype(::general::detail::tail_types(__VA_ARGS__))>(  \
+        std::integral_constant<bool,                                                           \
+            ::general::detail::check_format(GENERAL_DETAIL_FIRST(__VA_ARGS__),                 \
+                decltype(::general::detail::tail_types(__VA_ARGS__)) {})>())
+#define GENERAL_DETAIL_FIRST(...) GENERAL_DETAIL_FIRST_(__VA_ARGS__, ~)
+#define GENERAL_DETAIL_FIRST_(first, ...) first
+
 std::string tolower(std::string s);
 
 std::string toupper(std::string s);
@@ -40,19 +113,238 @@ std::ostream& print(std::ostream& os, BidIt beg, BidIt end,
 
 namespace general {
 
+namespace detail {
+
+    template <typename... T>
+    struct type_list {
+    };
+
+    // only used in decltype to get the argument types of a macro call, after the format string
+    template <typename Format, typename... Args>
+    type_list<std::decay_t<Args>...> tail_types(Format&&, Args&&...);
+
+    // std::string is passed to snprintf as its c_str()
+    template <typename T>
+    inline const T& arg(const T& x)
+    {
+        return x;
+    }
+
+    inline const char* arg(const std::string& s)
+    {
+        return s.c_str();
+    }
+
+    enum : unsigned {
+        INT = 1,
+        FLOAT = 2,
+        STRING = 4,
+        POINTER = 8
+    };
+
+    /**
+     * @brief Kind of an argument type in the low 4 bits, its size above
+     */
+    template <typename T>
+    constexpr unsigned classify()
+    {
+        return (std::is_integral<T>::value ? INT : 0u)
+            | (std::is_floating_point<T>::value ? FLOAT : 0u)
+            | (std::is_same<T, const char*>::value || std::is_same<T, char*>::value
+                      || std::is_same<T, std::string>::value
+                  ? STRING
+                  : 0u)
+            | (std::is_pointer<T>::value || std::is_null_pointer<T>::value ? POINTER : 0u)
+            | (static_cast<unsigned>(sizeof(T)) << 4);
+    }
+
+    constexpr bool is_digit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    constexpr bool accepts(unsigned cls, unsigned kind, char length1, char length2)
+    {
+        const size_t size = cls >> 4;
+        if (!(cls & kind)) {
+            return false;
+        }
+        if (kind == INT) {
+            // integers narrower than int are promoted
+            switch (length1) {
+            case 'l': return size == (length2 == 'l' ? sizeof(long long) : sizeof(long));
+            case 'z': return size == sizeof(size_t);
+            case 'j': return size == sizeof(intmax_t);
+            case 't': return size == sizeof(ptrdiff_t);
+            default: return size <= sizeof(int);
+            }
+        }
+        if (kind == FLOAT) {
+            return (length1 == 'L') == (size == sizeof(long double) && sizeof(long double) != sizeof(double));
+        }
+        return true;
+    }
+
+    /**
+     * @brief Check a printf format string against the classes of the arguments
+     */
+    constexpr bool check_format(const char* f, const unsigned* cls, size_t n)
+    {
+        size_t i = 0;
+        while (*f) {
+            if (*f++ != '%') {
+                continue;
+            }
+            if (*f == '%') {
+                f++;
+                continue;
+            }
+            while (*f == '-' || *f == '+' || *f == ' ' || *f == '#' || *f == '0') {
+                f++;
+            }
+            if (*f == '*') {
+                if (i == n || !accepts(cls[i++], INT, 0, 0)) {
+                    return false;
+                }
+                f++;
+            }
+            while (is_digit(*f)) {
+                f++;
+            }
+            if (*f == '.') {
+                f++;
+                if (*f == '*') {
+                    if (i == n || !accepts(cls[i++], INT, 0, 0)) {
+                        return false;
+                    }
+                    f++;
+                }
+                while (is_digit(*f)) {
+                    f++;
+                }
+            }
+            char length1 = 0, length2 = 0;
+            if (*f == 'h' || *f == 'l' || *f == 'z' || *f == 'j' || *f == 't' || *f == 'L') {
+                length1 = *f++;
+                if ((length1 == 'h' || length1 == 'l') && *f == length1) {
+                    length2 = *f++;
+                }
+            }
+            const char c = *f;
+            if (c == 0) {
+                return false;
+            }
+            f++;
+            unsigned kind = 0;
+            if (c == 'd' || c == 'i' || c == 'o' || c == 'u' || c == 'x' || c == 'X' || c == 'c') {
+                kind = INT;
+            } else if (c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G'
+                || c == 'a' || c == 'A') {
+                kind = FLOAT;
+            } else if (c == 's') {
+                kind = STRING;
+            } else if (c == 'p') {
+                kind = POINTER;
+            }
+            if (kind == 0 || i == n || !accepts(cls[i++], kind, length1, length2)) {
+                return false;
+            }
+        }
+        return i == n;
+    }
+
+    template <typename... T>
+    constexpr bool check_format(const char* f, type_list<T...>)
+    {
+        const unsigned cls[] = { classify<T>()..., 0 };
+        return check_format(f, cls, sizeof...(T));
+    }
+
+    template <typename List>
+    constexpr int format_checked(std::true_type)
+    {
+        return 0;
+    }
+
+    template <typename List>
+    constexpr int format_checked(std::false_type)
+    {
+        static_assert(sizeof(List) == 0, "format string does not match the argument types");
+        return 0;
+    }
+
+} // namespace detail
+
 // https://stackoverflow.com/questions/2342162/stdstring-formatting-like-sprintf/26221725#26221725
+// formats into a stack buffer first; only texts that do not fit are formatted a second time
 template <typename... Args>
 inline std::string format(const std::string& format, Args... args)
 {
-    int size_s = std::snprintf(nullptr, 0, format.c_str(), args...) + 1; // Extra space for '\0'
-    if (size_s <= 0) {
+    char buf[256];
+    const int size_s = std::snprintf(buf, sizeof(buf), format.c_str(), detail::arg(args)...);
+    if (size_s < 0) {
+        throw std::runtime_error("Error during formatting.");
+    }
+    const auto size = static_cast<size_t>(size_s);
+    if (size < sizeof(buf)) {
+        return std::string(buf, size);
+    }
+    std::string out(size, '\0');
+    // writing the '\0' at out[size] is allowed since C++11
+    std::snprintf(&out[0], size + 1, format.c_str(), detail::arg(args)...);
+    return out;
+}
+
+template <typename... Args>
+inline int format_to(char* buf, size_t size, const char* format, Args... args)
+{
+    return std::snprintf(buf, size, format, detail::arg(args)...);
+}
+
+template <size_t N>
+inline StackString<N>::StackString()
+    : _size(0)
+    , _truncated(false)
+{
+    static_assert(N > 0, "StackString needs room for the terminating null.");
+    _buf[0] = '\0';
+}
+
+template <size_t N>
+inline const char* StackString<N>::c_str() const
+{
+    return _buf;
+}
+
+template <size_t N>
+inline size_t StackString<N>::size() const
+{
+    return _size;
+}
+
+template <size_t N>
+inline bool StackString<N>::truncated() const
+{
+    return _truncated;
+}
+
+template <size_t N>
+inline std::string StackString<N>::str() const
+{
+    return std::string(_buf, _size);
+}
+
+template <size_t N, typename... Args>
+inline StackString<N> sformat(const char* format, Args... args)
+{
+    StackString<N> out;
+    const int size = format_to(out._buf, N, format, args...);
+    if (size < 0) {
         throw std::runtime_error("Error during formatting.");
     }
-    auto size = static_cast<size_t>(size_s);
-    auto buf = std::make_unique<char[]>(size);
-    std::snprintf(buf.get(), size, format.c_str(), args...);
-    return std::string(buf.get(),
-        buf.get() + size - 1); // We don't want the '\0' inside
+    out._truncated = static_cast<size_t>(size) >= N;
+    out._size = out._truncated ? N - 1 : static_cast<size_t>(size);
+    return out;
 }
 
 // https://en.cppreference.com/w/cpp/string/byte/tolower
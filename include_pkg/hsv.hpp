@@ -0,0 +1,343 @@
+#ifndef INCLUDE_PKG_HSV_HPP
+#define INCLUDE_PKG_HSV_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+#include <opencv2/core.hpp>
+
+namespace hsv {
+
+/**
+ * @brief Accepted HSV box in OpenCV's 8-bit HSV space
+ *
+ * @details Hue is in [0, 180), saturation & value are in [0, 255]. If h_lo > h_hi the hue range
+ * wraps around 0 (e.g. reds), i.e. a hue is accepted if h >= h_lo or h <= h_hi.
+ */
+struct Bounds {
+    int h_lo, h_hi;
+    int s_lo, s_hi;
+    int v_lo, v_hi;
+
+    /**
+     * @brief Check whether the hue range wraps around 0
+     */
+    bool wraps() const;
+
+    bool operator==(const Bounds& other) const;
+    bool operator!=(const Bounds& other) const;
+};
+
+/**
+ * @brief Convert one BGR pixel to HSV, bit-exact with cv::cvtColor(..., cv::COLOR_BGR2HSV)
+ *
+ * @return cv::Vec3b (H, S, V)
+ */
+cv::Vec3b bgr2hsv(uchar b, uchar g, uchar r);
+
+/**
+ * @brief Build the accepted HSV box around a color
+ *
+ * @param color Desired color in (B, G, R) order, as returned by read_params
+ * @param hue_range Hue range
+ * @param saturation_range Saturation range
+ * @param value_range Value range
+ * @return Bounds The accepted box, clamped to the valid HSV ranges
+ */
+Bounds make_bounds(cv::Scalar color, int hue_range, int saturation_range, int value_range);
+
+/**
+ * @brief Check whether a single BGR pixel is inside the box
+ */
+bool accept(const Bounds& bounds, uchar b, uchar g, uchar r);
+
+/**
+ * @brief Threshold a BGR image in HSV space in one pass
+ *
+ * @details The image is read once and the mask is written directly, without an intermediate HSV
+ * image. Uses AVX2 or SSE4.1 when the translation unit is compiled with -mavx2 / -msse4.1 and
+ * a scalar loop otherwise; all paths give the same result as cvtColor followed by inRange.
+ *
+ * @param bgr 8-bit 3-channel BGR image
+ * @param mask The output mask (CV_8UC1, 255 for accepted pixels), reallocated only if its size changes
+ * @param bounds Accepted HSV box
+ */
+void threshold(const cv::Mat& bgr, cv::Mat& mask, const Bounds& bounds);
+
+/**
+ * @brief Threshold a single row of packed BGR pixels
+ *
+ * @param src cols packed BGR pixels
+ * @param dst cols mask bytes (255 for accepted pixels)
+ * @param cols Number of pixels
+ * @param bounds Accepted HSV box
+ */
+void threshold_row(const uchar* src, uchar* dst, int cols, const Bounds& bounds);
+
+} // namespace hsv
+
+////////////////////////
+// INLINE DEFINITIONS //
+////////////////////////
+
+namespace hsv {
+
+namespace detail {
+
+    constexpr int shift = 12;
+
+    // the division tables cv::cvtColor uses for 8-bit images
+    struct Tables {
+        int32_t sdiv[256];
+        int32_t hdiv[256];
+
+        Tables()
+        {
+            sdiv[0] = hdiv[0] = 0;
+            for (int i = 1; i < 256; i++) {
+                sdiv[i] = static_cast<int32_t>(std::lround((255 << shift) / (1. * i)));
+                hdiv[i] = static_cast<int32_t>(std::lround((180 << shift) / (6. * i)));
+            }
+        }
+    };
+
+    inline const Tables& tables()
+    {
+        static const Tables t;
+        return t;
+    }
+
+    inline void hsv_scalar(const Tables& t, int b, int g, int r, int& h, int& s, int& v)
+    {
+        v = std::max(b, std::max(g, r));
+        const int vmin = std::min(b, std::min(g, r));
+        const int diff = v - vmin;
+        const int vr = v == r ? -1 : 0;
+        const int vg = v == g ? -1 : 0;
+
+        s = (diff * t.sdiv[v] + (1 << (shift - 1))) >> shift;
+        h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + ((~vg) & (r - g + 4 * diff))));
+        h = (h * t.hdiv[diff] + (1 << (shift - 1))) >> shift;
+        h += h < 0 ? 180 : 0;
+    }
+
+    inline bool in_bounds(const Bounds& bd, int h, int s, int v)
+    {
+        const bool hue_ok = bd.h_lo <= bd.h_hi ? (h >= bd.h_lo && h <= bd.h_hi)
+                                               : (h >= bd.h_lo || h <= bd.h_hi);
+        return hue_ok && s >= bd.s_lo && s <= bd.s_hi && v >= bd.v_lo && v <= bd.v_hi;
+    }
+
+    inline void threshold_row_scalar(const Tables& t, const Bounds& bd, const uchar* src,
+        uchar* dst, int from, int to)
+    {
+        for (int x = from; x < to; x++) {
+            int h, s, v;
+            hsv_scalar(t, src[3 * x], src[3 * x + 1], src[3 * x + 2], h, s, v);
+            dst[x] = in_bounds(bd, h, s, v) ? 255 : 0;
+        }
+    }
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+    // spread the bytes of 4 packed BGR pixels into 32-bit lanes
+    inline __m128i shuffle_b() { return _mm_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1); }
+    inline __m128i shuffle_g() { return _mm_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1); }
+    inline __m128i shuffle_r() { return _mm_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1); }
+#endif
+
+#if defined(__AVX2__)
+    // HSV of 8 packed BGR pixels in 32-bit lanes; reads 4 bytes past the 8th pixel
+    inline void hsv_simd(const Tables& t, const uchar* src, __m256i& h, __m256i& s, __m256i& v)
+    {
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+        const __m256i b = _mm256_set_m128i(_mm_shuffle_epi8(hi, shuffle_b()), _mm_shuffle_epi8(lo, shuffle_b()));
+        const __m256i g = _mm256_set_m128i(_mm_shuffle_epi8(hi, shuffle_g()), _mm_shuffle_epi8(lo, shuffle_g()));
+        const __m256i r = _mm256_set_m128i(_mm_shuffle_epi8(hi, shuffle_r()), _mm_shuffle_epi8(lo, shuffle_r()));
+        const __m256i half = _mm256_set1_epi32(1 << (shift - 1));
+
+        v = _mm256_max_epi32(b, _mm256_max_epi32(g, r));
+        const __m256i diff = _mm256_sub_epi32(v, _mm256_min_epi32(b, _mm256_min_epi32(g, r)));
+        const __m256i vr = _mm256_cmpeq_epi32(v, r);
+        const __m256i vg = _mm256_cmpeq_epi32(v, g);
+
+        const __m256i sdiv = _mm256_i32gather_epi32(t.sdiv, v, 4);
+        s = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(diff, sdiv), half), shift);
+
+        const __m256i h_r = _mm256_sub_epi32(g, b);
+        const __m256i h_g = _mm256_add_epi32(_mm256_sub_epi32(b, r), _mm256_add_epi32(diff, diff));
+        const __m256i h_b = _mm256_add_epi32(_mm256_sub_epi32(r, g), _mm256_slli_epi32(diff, 2));
+        h = _mm256_blendv_epi8(_mm256_blendv_epi8(h_b, h_g, vg), h_r, vr);
+        const __m256i hdiv = _mm256_i32gather_epi32(t.hdiv, diff, 4);
+        h = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(h, hdiv), half), shift);
+        h = _mm256_add_epi32(h, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), h),
+                                    _mm256_set1_epi32(180)));
+    }
+
+    // 8 pixels per iteration; reads 4 bytes past the 8th pixel
+    inline int threshold_row_simd(const Tables& t, const Bounds& bd, const uchar* src,
+        uchar* dst, int cols)
+    {
+        const __m256i h_lo = _mm256_set1_epi32(bd.h_lo - 1), h_hi = _mm256_set1_epi32(bd.h_hi + 1);
+        const __m256i s_lo = _mm256_set1_epi32(bd.s_lo - 1), s_hi = _mm256_set1_epi32(bd.s_hi + 1);
+        const __m256i v_lo = _mm256_set1_epi32(bd.v_lo - 1), v_hi = _mm256_set1_epi32(bd.v_hi + 1);
+        const bool wraps = bd.wraps();
+
+        int x = 0;
+        for (; x + 10 <= cols; x += 8) {
+            __m256i h, s, v;
+            hsv_simd(t, src + 3 * x, h, s, v);
+
+            const __m256i h_ge = _mm256_cmpgt_epi32(h, h_lo);
+            const __m256i h_le = _mm256_cmpgt_epi32(h_hi, h);
+            __m256i m = wraps ? _mm256_or_si256(h_ge, h_le) : _mm256_and_si256(h_ge, h_le);
+            m = _mm256_and_si256(m, _mm256_and_si256(_mm256_cmpgt_epi32(s, s_lo), _mm256_cmpgt_epi32(s_hi, s)));
+            m = _mm256_and_si256(m, _mm256_and_si256(_mm256_cmpgt_epi32(v, v_lo), _mm256_cmpgt_epi32(v_hi, v)));
+
+            const __m128i m16 = _mm_packs_epi32(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packs_epi16(m16, m16));
+        }
+        return x;
+    }
+#elif defined(__SSE4_1__)
+    // HSV of 4 packed BGR pixels in 32-bit lanes; reads 4 bytes past the 4th pixel
+    inline void hsv_simd(const Tables& t, const uchar* src, __m128i& h, __m128i& s, __m128i& v)
+    {
+        const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        const __m128i b = _mm_shuffle_epi8(px, shuffle_b());
+        const __m128i g = _mm_shuffle_epi8(px, shuffle_g());
+        const __m128i r = _mm_shuffle_epi8(px, shuffle_r());
+        const __m128i half = _mm_set1_epi32(1 << (shift - 1));
+
+        v = _mm_max_epi32(b, _mm_max_epi32(g, r));
+        const __m128i diff = _mm_sub_epi32(v, _mm_min_epi32(b, _mm_min_epi32(g, r)));
+        const __m128i vr = _mm_cmpeq_epi32(v, r);
+        const __m128i vg = _mm_cmpeq_epi32(v, g);
+
+        const __m128i sdiv = _mm_setr_epi32(t.sdiv[_mm_extract_epi32(v, 0)], t.sdiv[_mm_extract_epi32(v, 1)],
+            t.sdiv[_mm_extract_epi32(v, 2)], t.sdiv[_mm_extract_epi32(v, 3)]);
+        s = _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(diff, sdiv), half), shift);
+
+        const __m128i h_r = _mm_sub_epi32(g, b);
+        const __m128i h_g = _mm_add_epi32(_mm_sub_epi32(b, r), _mm_add_epi32(diff, diff));
+        const __m128i h_b = _mm_add_epi32(_mm_sub_epi32(r, g), _mm_slli_epi32(diff, 2));
+        h = _mm_blendv_epi8(_mm_blendv_epi8(h_b, h_g, vg), h_r, vr);
+        const __m128i hdiv = _mm_setr_epi32(t.hdiv[_mm_extract_epi32(diff, 0)], t.hdiv[_mm_extract_epi32(diff, 1)],
+            t.hdiv[_mm_extract_epi32(diff, 2)], t.hdiv[_mm_extract_epi32(diff, 3)]);
+        h = _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(h, hdiv), half), shift);
+        h = _mm_add_epi32(h, _mm_and_si128(_mm_cmpgt_epi32(_mm_setzero_si128(), h), _mm_set1_epi32(180)));
+    }
+
+    // 4 pixels per iteration; reads 4 bytes past the 4th pixel
+    inline int threshold_row_simd(const Tables& t, const Bounds& bd, const uchar* src,
+        uchar* dst, int cols)
+    {
+        const __m128i h_lo = _mm_set1_epi32(bd.h_lo - 1), h_hi = _mm_set1_epi32(bd.h_hi + 1);
+        const __m128i s_lo = _mm_set1_epi32(bd.s_lo - 1), s_hi = _mm_set1_epi32(bd.s_hi + 1);
+        const __m128i v_lo = _mm_set1_epi32(bd.v_lo - 1), v_hi = _mm_set1_epi32(bd.v_hi + 1);
+        const bool wraps = bd.wraps();
+
+        int x = 0;
+        for (; x + 6 <= cols; x += 4) {
+            __m128i h, s, v;
+            hsv_simd(t, src + 3 * x, h, s, v);
+
+            const __m128i h_ge = _mm_cmpgt_epi32(h, h_lo);
+            const __m128i h_le = _mm_cmpgt_epi32(h_hi, h);
+            __m128i m = wraps ? _mm_or_si128(h_ge, h_le) : _mm_and_si128(h_ge, h_le);
+            m = _mm_and_si128(m, _mm_and_si128(_mm_cmpgt_epi32(s, s_lo), _mm_cmpgt_epi32(s_hi, s)));
+            m = _mm_and_si128(m, _mm_and_si128(_mm_cmpgt_epi32(v, v_lo), _mm_cmpgt_epi32(v_hi, v)));
+
+            const __m128i m16 = _mm_packs_epi32(m, m);
+            const int m8 = _mm_cvtsi128_si32(_mm_packs_epi16(m16, m16));
+            std::memcpy(dst + x, &m8, 4);
+        }
+        return x;
+    }
+#else
+    inline int threshold_row_simd(const Tables&, const Bounds&, const uchar*, uchar*, int)
+    {
+        return 0;
+    }
+#endif
+
+} // namespace detail
+
+inline bool Bounds::wraps() const
+{
+    return h_lo > h_hi;
+}
+
+inline bool Bounds::operator==(const Bounds& o) const
+{
+    return h_lo == o.h_lo && h_hi == o.h_hi && s_lo == o.s_lo && s_hi == o.s_hi
+        && v_lo == o.v_lo && v_hi == o.v_hi;
+}
+
+inline bool Bounds::operator!=(const Bounds& o) const
+{
+    return !(*this == o);
+}
+
+inline cv::Vec3b bgr2hsv(uchar b, uchar g, uchar r)
+{
+    int h, s, v;
+    detail::hsv_scalar(detail::tables(), b, g, r, h, s, v);
+    return cv::Vec3b(static_cast<uchar>(h), static_cast<uchar>(s), static_cast<uchar>(v));
+}
+
+inline Bounds make_bounds(cv::Scalar color, int hue_range, int saturation_range, int value_range)
+{
+    const cv::Vec3b c = bgr2hsv(cv::saturate_cast<uchar>(color[0]),
+        cv::saturate_cast<uchar>(color[1]), cv::saturate_cast<uchar>(color[2]));
+    Bounds bd;
+    if (2 * hue_range + 1 >= 180) {
+        bd.h_lo = 0;
+        bd.h_hi = 179;
+    } else {
+        bd.h_lo = (c[0] - hue_range + 180) % 180;
+        bd.h_hi = (c[0] + hue_range) % 180;
+    }
+    bd.s_lo = std::max(c[1] - saturation_range, 0);
+    bd.s_hi = std::min(c[1] + saturation_range, 255);
+    bd.v_lo = std::max(c[2] - value_range, 0);
+    bd.v_hi = std::min(c[2] + value_range, 255);
+    return bd;
+}
+
+inline bool accept(const Bounds& bounds, uchar b, uchar g, uchar r)
+{
+    int h, s, v;
+    detail::hsv_scalar(detail::tables(), b, g, r, h, s, v);
+    return detail::in_bounds(bounds, h, s, v);
+}
+
+inline void threshold(const cv::Mat& bgr, cv::Mat& mask, const Bounds& bounds)
+{
+    if (bgr.type() != CV_8UC3) {
+        throw std::invalid_argument("hsv::threshold expects an 8-bit BGR image.");
+    }
+    mask.create(bgr.rows, bgr.cols, CV_8UC1);
+    for (int y = 0; y < bgr.rows; y++) {
+        threshold_row(bgr.ptr<uchar>(y), mask.ptr<uchar>(y), bgr.cols, bounds);
+    }
+}
+
+inline void threshold_row(const uchar* src, uchar* dst, int cols, const Bounds& bounds)
+{
+    const detail::Tables& t = detail::tables();
+    const int x = detail::threshold_row_simd(t, bounds, src, dst, cols);
+    detail::threshold_row_scalar(t, bounds, src, dst, x, cols);
+}
+
+} // namespace hsv
+
+#endif // INCLUDE_PKG_HSV_HPP
@@ -1,15 +1,26 @@
 #ifndef INCLUDE_PKG_TEST_HPP
 #define INCLUDE_PKG_TEST_HPP
 
+#include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <exception>
+#include <fstream>
 #include <functional>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include <include_pkg/ThreadPool.hpp>
+
 /**
  * @brief Custom exception class for test failures
  */
@@ -42,13 +53,73 @@ public:
     const char* what() const noexcept override;
 };
 
+/**
+ * @brief Settings of call_tests, shared by every call
+ */
+struct Options {
+    /**
+     * @brief Number of tests run at the same time (0 for one per core)
+     */
+    size_t threads = 1;
+
+    /**
+     * @brief Tests that must run on the calling thread, e.g. the ones using the OpenCV GUI
+     *
+     * @details They run one by one after the other tests.
+     */
+    std::vector<std::string> serial;
+
+    /**
+     * @brief Comma separated substrings; only tests whose name contains one of them are run
+     */
+    std::string filter;
+
+    /**
+     * @brief Number of times every test is run
+     */
+    int repeat = 1;
+
+    /**
+     * @brief Number of slowest tests listed at the end
+     */
+    size_t slowest = 5;
+
+    /**
+     * @brief Write a JUnit XML report to this file if not empty
+     */
+    std::string junit;
+
+    /**
+     * @brief Write a JSON report to this file if not empty
+     */
+    std::string json;
+};
+
+/**
+ * @brief Get the settings used by call_tests
+ */
+Options& options();
+
+/**
+ * @brief Read the settings from the command line
+ *
+ * @details Understands --threads N, --filter A,B, --repeat N, --slowest N, --serial NAME,
+ * --junit FILE and --json FILE. Unknown arguments are reported and skipped; an option missing
+ * its value is reported and exits with EXIT_FAILURE, so a mistyped run cannot pass silently.
+ */
+void parse_args(int argc, char** argv);
+
 /**
  * @brief Call a list of test functions and send results.
  * 
+ * @details Each test is timed; a test fails on a check_error or any other exception.
+ * See Options for parallel runs, filters, repeats and reports.
+ *
  * @param funcs A vector of test functions
  * @param func_names A vector of test function names
+ * @return int Number of failed tests
  */
-void call_tests(std::vector<std::function<void()>>&& funcs,
+int call_tests(std::vector<std::function<void()>>&& funcs,
     std::vector<std::string>&& func_names = {});
 
 // ("this is a test", ' ') -> {"this", "is", "a", "test"}
@@ -201,37 +272,276 @@ inline const char* check_error::what() const noexcept
     return what_arg.c_str();
 }
 
-inline void call_tests(std::vector<std::function<void()>>&& funcs,
-    std::vector<std::string>&& func_names)
+inline Options& options()
 {
-    if (func_names.empty()) {
-        func_names.resize(funcs.size());
+    static Options opt;
+    return opt;
+}
+
+inline void parse_args(int argc, char** argv)
+{
+    Options& opt = options();
+    const char* const valued[] = { "--threads", "--filter", "--repeat", "--slowest", "--serial",
+        "--junit", "--json" };
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (std::find(std::begin(valued), std::end(valued), arg) == std::end(valued)) {
+            std::cerr << "Unknown test option " << arg << std::endl;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Test option " << arg << " needs a value" << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        const std::string value = argv[++i];
+        if (arg == "--threads") {
+            opt.threads = std::strtoul(value.c_str(), nullptr, 10);
+        } else if (arg == "--filter") {
+            opt.filter = value;
+        } else if (arg == "--repeat") {
+            opt.repeat = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--slowest") {
+            opt.slowest = std::strtoul(value.c_str(), nullptr, 10);
+        } else if (arg == "--serial") {
+            opt.serial.push_back(value);
+        } else if (arg == "--junit") {
+            opt.junit = value;
+        } else {
+            opt.json = value;
+        }
     }
-    CHECK_EQ(funcs.size(), func_names.size());
-    int num_tests = 0;
-    int success = 0;
-    for (size_t i = 0; i < funcs.size(); i++) {
+}
+
+namespace detail {
+
+    struct TestResult {
+        int number;
+        std::string name;
+        bool run = false;
+        bool passed = false;
+        double seconds = 0;
+        std::string message;
+    };
+
+    // the messages of check_error are colored for the terminal
+    inline std::string strip_colors(const std::string& s)
+    {
+        std::string out;
+        for (size_t i = 0; i < s.size(); i++) {
+            if (s[i] == '\033') {
+                while (i < s.size() && s[i] != 'm') {
+                    i++;
+                }
+                continue;
+            }
+            out += s[i];
+        }
+        return out;
+    }
+
+    inline std::string escape(const std::string& s, bool xml)
+    {
+        std::string out;
+        for (const char c : strip_colors(s)) {
+            if (xml) {
+                switch (c) {
+                case '<': out += "&lt;"; break;
+                case '>': out += "&gt;"; break;
+                case '&': out += "&amp;"; break;
+                case '"': out += "&quot;"; break;
+                case '\n': out += "&#10;"; break;
+                default: out += c;
+                }
+            } else if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (c == '\n') {
+                out += "\\n";
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+        return out;
+    }
+
+    inline bool selected(const std::string& name, const std::string& filter)
+    {
+        if (filter.empty()) {
+            return true;
+        }
+        for (const std::string& pattern : split(filter, ',')) {
+            if (name.find(trim(pattern)) != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline void run_test(const std::function<void()>& func, TestResult& res, int repeat)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        res.run = true;
+        res.passed = true;
         try {
-            std::cout << ::test::Color::Orange() << "\nTest #" << ++num_tests;
-            func_names[i] = trim(func_names[i]);
-            if (!func_names[i].empty()) {
-                std::cout << " : " << func_names[i];
+            for (int r = 0; r < repeat; r++) {
+                func();
             }
-            std::cout << ::test::Color::Default() << std::endl;
-            funcs[i]();
-            ++success;
-            std::cout << ::test::Color::Green() << "Test #" << num_tests
-                      << " succeeded!\n";
         } catch (const check_error& e) {
+            res.passed = false;
+            res.message = e.what();
+        } catch (const std::exception& e) {
+            res.passed = false;
+            res.message = std::string("Exception: ") + e.what();
+        } catch (...) {
+            res.passed = false;
+            res.message = "Unknown exception";
+        }
+        res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    inline void print_header(const TestResult& res)
+    {
+        std::cout << ::test::Color::Orange() << "\nTest #" << res.number;
+        if (!res.name.empty()) {
+            std::cout << " : " << res.name;
+        }
+        std::cout << ::test::Color::Default() << std::endl;
+    }
+
+    inline void print_result(const TestResult& res)
+    {
+        if (res.passed) {
+            std::cout << ::test::Color::Green() << "Test #" << res.number << " succeeded! ("
+                      << res.seconds * 1e3 << " ms)" << ::test::Color::Default() << "\n";
+        } else {
             std::cerr << "\n\n"
-                      << e.what() << std::endl;
+                      << res.message << std::endl;
         }
         std::cout << "\n\n"
                   << std::flush;
     }
+
+    inline void write_junit(const std::string& path, const std::vector<TestResult>& results)
+    {
+        int tests = 0, failures = 0;
+        double total = 0;
+        for (const TestResult& r : results) {
+            tests += r.run;
+            failures += r.run && !r.passed;
+            total += r.seconds;
+        }
+        std::ofstream os(path);
+        os << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+        os << "<testsuite name=\"tests\" tests=\"" << tests << "\" failures=\"" << failures
+           << "\" time=\"" << total << "\">\n";
+        for (const TestResult& r : results) {
+            if (!r.run) {
+                continue;
+            }
+            os << "  <testcase name=\"" << escape(r.name, true) << "\" time=\"" << r.seconds << "\"";
+            if (r.passed) {
+                os << "/>\n";
+            } else {
+                os << ">\n    <failure message=\"" << escape(r.message, true) << "\"/>\n  </testcase>\n";
+            }
+        }
+        os << "</testsuite>\n";
+    }
+
+    inline void write_json(const std::string& path, const std::vector<TestResult>& results)
+    {
+        std::ofstream os(path);
+        os << "{\n  \"tests\": [";
+        bool first = true;
+        for (const TestResult& r : results) {
+            if (!r.run) {
+                continue;
+            }
+            os << (first ? "\n" : ",\n") << "    { \"number\": " << r.number << ", \"name\": \""
+               << escape(r.name, false) << "\", \"passed\": " << (r.passed ? "true" : "false")
+               << ", \"seconds\": " << r.seconds << ", \"message\": \"" << escape(r.message, false)
+               << "\" }";
+            first = false;
+        }
+        os << "\n  ]\n}\n";
+    }
+
+} // namespace detail
+
+inline int call_tests(std::vector<std::function<void()>>&& funcs,
+    std::vector<std::string>&& func_names)
+{
+    if (func_names.empty()) {
+        func_names.resize(funcs.size());
+    }
+    CHECK_EQ(funcs.size(), func_names.size());
+    const Options& opt = options();
+
+    std::vector<detail::TestResult> results(funcs.size());
+    std::vector<size_t> parallel, serial;
+    for (size_t i = 0; i < funcs.size(); i++) {
+        results[i].number = static_cast<int>(i + 1);
+        results[i].name = trim(func_names[i]);
+        if (!detail::selected(results[i].name, opt.filter)) {
+            continue;
+        }
+        const bool gui = std::find(opt.serial.begin(), opt.serial.end(), results[i].name)
+            != opt.serial.end();
+        (gui || opt.threads == 1 ? serial : parallel).push_back(i);
+    }
+
+    if (!parallel.empty()) {
+        ThreadPool pool(opt.threads);
+        std::mutex print_mutex;
+        pool.parallel_for(parallel.size(), [&](size_t k) {
+            detail::TestResult& res = results[parallel[k]];
+            detail::run_test(funcs[parallel[k]], res, opt.repeat);
+            std::lock_guard<std::mutex> lock(print_mutex);
+            detail::print_header(res);
+            detail::print_result(res);
+        });
+    }
+    for (size_t i : serial) {
+        detail::print_header(results[i]);
+        detail::run_test(funcs[i], results[i], opt.repeat);
+        detail::print_result(results[i]);
+    }
+
+    int num_tests = 0;
+    int success = 0;
+    std::vector<const detail::TestResult*> ran;
+    for (const detail::TestResult& r : results) {
+        if (r.run) {
+            ++num_tests;
+            success += r.passed;
+            ran.push_back(&r);
+        }
+    }
+    std::sort(ran.begin(), ran.end(),
+        [](const detail::TestResult* a, const detail::TestResult* b) { return a->seconds > b->seconds; });
+    if (opt.slowest > 0 && !ran.empty()) {
+        std::cout << ::test::Color::Blue() << "Slowest tests:" << ::test::Color::Default() << "\n";
+        for (size_t i = 0; i < ran.size() && i < opt.slowest; i++) {
+            std::cout << "  #" << ran[i]->number << " " << ran[i]->name << ": "
+                      << ran[i]->seconds * 1e3 << " ms\n";
+        }
+    }
+
+    if (!opt.junit.empty()) {
+        detail::write_junit(opt.junit, results);
+    }
+    if (!opt.json.empty()) {
+        detail::write_json(opt.json, results);
+    }
+
     std::cout << ::test::Color::Green() << "\n"
               << success << "/" << num_tests << " tests passed"
               << ::test::Color::Default() << std::endl;
+    return num_tests - success;
 }
 
 inline std::vector<std::string> split(const std::string& str, char delim)
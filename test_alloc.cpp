@@ -0,0 +1,277 @@
+// Allocation tests of DetectorContext: once warmed up, the color detections do not allocate
+// build: g++ -std=c++17 -O2 -march=native -I. test_alloc.cpp -o test_alloc `pkg-config --cflags --libs opencv4` -pthread
+// usage: ./test_alloc [--filter A,B] [--repeat N] [--threads N] [--junit FILE] [--json FILE]
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <tuple>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <include_pkg/ColorLut.hpp>
+#include <include_pkg/bench.hpp>
+#include <include_pkg/detect.hpp>
+#include <include_pkg/test.hpp>
+
+namespace {
+
+// heap allocations of the calling thread while counting is on; per thread, so tests may run in parallel
+thread_local bool counting = false;
+thread_local size_t heap_allocations = 0;
+
+void* counted_malloc(size_t size)
+{
+    if (counting) {
+        ++heap_allocations;
+    }
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* counted_aligned_alloc(size_t size, std::align_val_t align)
+{
+    if (counting) {
+        ++heap_allocations;
+    }
+    const size_t a = static_cast<size_t>(align);
+    void* p = std::aligned_alloc(a, (size + a - 1) / a * a);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+} // namespace
+
+void* operator new(size_t size)
+{
+    return counted_malloc(size);
+}
+
+void* operator new[](size_t size)
+{
+    return counted_malloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t align)
+{
+    return counted_aligned_alloc(size, align);
+}
+
+void* operator new[](size_t size, std::align_val_t align)
+{
+    return counted_aligned_alloc(size, align);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+
+const int frames = 16;
+const std::tuple<cv::Scalar, int, int, int> params(cv::Scalar(40, 40, 220), 10, 80, 80);
+
+/**
+ * @brief Counts the cv::Mat buffers it hands out; they come from cv::fastMalloc, not operator new
+ */
+class CountingAllocator : public cv::MatAllocator {
+public:
+    mutable size_t allocations = 0;
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+        cv::AccessFlag flags, cv::UMatUsageFlags usage) const override
+    {
+        if (!data) {
+            ++allocations;
+        }
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usage);
+    }
+
+    bool allocate(cv::UMatData* u, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override
+    {
+        return cv::Mat::getStdAllocator()->allocate(u, flags, usage);
+    }
+
+    void deallocate(cv::UMatData* u) const override
+    {
+        cv::Mat::getStdAllocator()->deallocate(u);
+    }
+};
+
+/**
+ * @brief Distinct frames of the same size, made before anything is counted
+ */
+std::vector<cv::Mat> make_frames()
+{
+    std::vector<cv::Mat> imgs;
+    for (int i = 0; i < frames; i++) {
+        imgs.push_back(bench::synthetic_frame(cv::Size(640, 480), static_cast<uint64_t>(i) + 1));
+    }
+    return imgs;
+}
+
+/**
+ * @brief Warm up on every frame, then count the heap and cv::Mat allocations of a second pass
+ *
+ * @details The number of runs and groups changes from frame to frame, so the labeler vectors only
+ * reach their final capacity after the largest frame; a single warm-up frame is not enough.
+ */
+template <typename F>
+void count_allocations(const std::vector<cv::Mat>& imgs, const CountingAllocator& mats, F&& detect,
+    size_t& heap, size_t& buffers)
+{
+    for (const cv::Mat& img : imgs) {
+        detect(img);
+    }
+    const size_t mats_before = mats.allocations;
+    heap_allocations = 0;
+    counting = true;
+    for (const cv::Mat& img : imgs) {
+        detect(img);
+    }
+    counting = false;
+    heap = heap_allocations;
+    buffers = mats.allocations - mats_before;
+}
+
+void test_color_mask()
+{
+    const std::vector<cv::Mat> imgs = make_frames();
+    CountingAllocator mats;
+    DetectorContext ctx(&mats);
+    size_t heap, buffers;
+    count_allocations(imgs, mats, [&](const cv::Mat& img) {
+        ctx.color_mask(img, std::get<0>(params), std::get<1>(params), std::get<2>(params),
+            std::get<3>(params));
+    },
+        heap, buffers);
+    CHECK_EQ(heap, 0u);
+    CHECK_EQ(buffers, 0u);
+}
+
+void test_color_mask_lut()
+{
+    const std::vector<cv::Mat> imgs = make_frames();
+    const ColorLut lut(hsv::make_bounds(std::get<0>(params), std::get<1>(params),
+        std::get<2>(params), std::get<3>(params)));
+    CountingAllocator mats;
+    DetectorContext ctx(&mats);
+    size_t heap, buffers;
+    count_allocations(imgs, mats, [&](const cv::Mat& img) { ctx.color_mask(img, lut); }, heap, buffers);
+    CHECK_EQ(heap, 0u);
+    CHECK_EQ(buffers, 0u);
+}
+
+void test_detect_color()
+{
+    const std::vector<cv::Mat> imgs = make_frames();
+    CountingAllocator mats;
+    DetectorContext ctx(&mats);
+    size_t heap, buffers;
+    int found = 0;
+    count_allocations(imgs, mats, [&](const cv::Mat& img) { found += ctx.detect_color(img, params).second > 0; },
+        heap, buffers);
+    CHECK_GT(found, 0);
+    CHECK_EQ(heap, 0u);
+    CHECK_EQ(buffers, 0u);
+}
+
+void test_detect_color_lut()
+{
+    const std::vector<cv::Mat> imgs = make_frames();
+    const ColorLut lut(hsv::make_bounds(std::get<0>(params), std::get<1>(params),
+        std::get<2>(params), std::get<3>(params)));
+    CountingAllocator mats;
+    DetectorContext ctx(&mats);
+    size_t heap, buffers;
+    int found = 0;
+    count_allocations(imgs, mats, [&](const cv::Mat& img) { found += ctx.detect_color(img, lut).second > 0; },
+        heap, buffers);
+    CHECK_GT(found, 0);
+    CHECK_EQ(heap, 0u);
+    CHECK_EQ(buffers, 0u);
+}
+
+void test_detect_color_fit()
+{
+    const std::vector<cv::Mat> imgs = make_frames();
+    CountingAllocator mats;
+    DetectorContext ctx(&mats);
+    size_t heap, buffers;
+    int found = 0;
+    count_allocations(imgs, mats, [&](const cv::Mat& img) { found += ctx.detect_color_fit(img, params).valid; },
+        heap, buffers);
+    CHECK_GT(found, 0);
+    CHECK_EQ(heap, 0u);
+    CHECK_EQ(buffers, 0u);
+}
+
+// cv::HoughCircles allocates its accumulator and edge lists on every call, so only the buffers of
+// the context are checked, not the heap
+void test_detect_circle()
+{
+    const std::vector<cv::Mat> imgs = make_frames();
+    CountingAllocator mats;
+    DetectorContext ctx(&mats);
+    for (int levels = 0; levels <= 2; levels++) {
+        size_t heap, buffers;
+        count_allocations(imgs, mats, [&](const cv::Mat& img) { ctx.detect_circle_pyramid(img, levels); },
+            heap, buffers);
+        CHECK_EQ(buffers, 0u);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    test::parse_args(argc, argv);
+    const int failed = test::call_tests(
+        { test_color_mask, test_color_mask_lut, test_detect_color, test_detect_color_lut,
+            test_detect_color_fit, test_detect_circle },
+        { "test_color_mask", "test_color_mask_lut", "test_detect_color", "test_detect_color_lut",
+            "test_detect_color_fit", "test_detect_circle" });
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}